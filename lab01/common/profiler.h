@@ -0,0 +1,115 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+
+/**
+* Frame timing for the main loop. beginFrame() and endFrame() around a frame
+* keep the last window frame times for percentiles. Zones in between time
+* parts of the frame on the CPU and, unless gpu is false, on the GPU with
+* GL_TIME_ELAPSED queries. The queries are double buffered: those of a frame
+* are read back two frames later, when they are done, so reading them does
+* not stall. Time elapsed queries can't nest, so a GPU zone inside another
+* one is timed on the CPU only.
+*
+* With a trace path the zones of the first traceFrames frames are written as
+* a Chrome trace (chrome://tracing or Perfetto) when the profiler is
+* destroyed. The GPU zones get their own track and are placed where the CPU
+* issued them, as the queries only measure durations. Call finish() before
+* the context is destroyed, or the GPU zones of the last two frames are
+* missing from the trace.
+*/
+class Profiler {
+public:
+    Profiler(const std::string& tracePath = "", int window = 240,
+        int traceFrames = 1000);
+    ~Profiler();
+
+    void beginFrame();
+    /* True every window frames, when summary() has new numbers */
+    bool endFrame();
+
+    void beginZone(const char* name, bool gpu = true);
+    void endZone();
+
+    /* Read the queries still in flight and delete them, after the last frame */
+    void finish();
+
+    /* The percentile (0-100) of the last window frame times, in ms */
+    double frameTime(double percentile) const;
+
+    /* p50/p95/p99 frame time and the average CPU/GPU ms of each zone */
+    std::string summary() const;
+
+    /* Throws if the file can't be written */
+    void writeTrace(const std::string& path) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Zone {
+        std::string name;
+        double cpu, gpu;  // ms, summed over the current window
+        double averageCpu, averageGpu;  // ms per frame over the last window
+    };
+    struct OpenZone {
+        int zone, query;  // query is -1 for CPU only zones
+        double start;
+    };
+    struct Query {
+        GLuint id;
+        int zone;
+        double start;
+        bool traced;
+    };
+    struct TraceEvent {
+        int zone;  // -1 for the frame
+        bool gpu;
+        double start, duration;  // us
+    };
+
+    Profiler(const Profiler&);
+    Profiler& operator=(const Profiler&);
+
+    int zoneIndex(const char* name);
+    void readQueries(std::vector<Query>& queries, int count);
+    double now() const;
+
+    std::string tracePath;
+    int window, traceFrames, frame;
+    Clock::time_point origin;
+    double frameStart;
+    std::vector<double> frameTimes;  // ring buffer of the last window frames
+    std::vector<Zone> zones;
+    std::map<std::string, int> namedZones;
+    std::vector<OpenZone> openZones;
+    bool gpuZoneOpen;
+    // the queries of even and odd frames, and how many of them were issued
+    std::vector<Query> queries[2];
+    int issued[2];
+    std::vector<TraceEvent> trace;
+};
+
+/* Times the enclosing scope as a zone of profiler */
+class ProfileZone {
+public:
+    ProfileZone(Profiler& profiler, const char* name, bool gpu = true) :
+        profiler(profiler) {
+        profiler.beginZone(name, gpu);
+    }
+    ~ProfileZone() {
+        profiler.endZone();
+    }
+
+private:
+    ProfileZone(const ProfileZone&);
+    ProfileZone& operator=(const ProfileZone&);
+
+    Profiler& profiler;
+};
+
+#endif
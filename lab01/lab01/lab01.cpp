@@ -11,6 +11,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/profiler.h>
 
 using namespace std;
 
@@ -26,6 +27,7 @@ void free();
 
 // Global variables
 GLFWwindow* window;
+Profiler profiler;
 GLuint shaderProgram;
 GLuint triangleVAO;
 GLuint verticesVBO, colorsVBO;
@@ -83,6 +85,7 @@ void free()
     glDeleteBuffers(1, &colorsVBO);
     glDeleteVertexArrays(1, &triangleVAO);
     glDeleteProgram(shaderProgram);
+    profiler.finish();
 
     // Close OpenGL window and terminate GLFW
     glfwTerminate();
@@ -92,6 +95,8 @@ void mainLoop()
 {
     do
     {
+        profiler.beginFrame();
+
         // Clear the screen.
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -119,6 +124,11 @@ void mainLoop()
 
         // Events
         glfwPollEvents();
+
+        // frame time percentiles in the title
+        if (profiler.endFrame()) {
+            glfwSetWindowTitle(window, (string(TITLE) + " | " + profiler.summary()).c_str());
+        }
     } // Check if the ESC key was pressed or the window was closed
     while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
@@ -16,6 +16,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/profiler.h>
 #include <map>
 
 using namespace std;
@@ -33,6 +34,7 @@ void free();
 
 // Global variables
 GLFWwindow* window;
+Profiler profiler;
 GLuint shaderProgram;
 GLuint MVPLocation;
 GLuint triangleVAO, cubeVAO;
@@ -182,6 +184,7 @@ void free()
     glDeleteBuffers(1, &cubeColorsVBO);
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteProgram(shaderProgram);
+    profiler.finish();
 
     glfwTerminate();
 }
@@ -303,6 +306,8 @@ void mainLoop()
 
     do
     {
+        profiler.beginFrame();
+
         // Task: depth test  | GL_DEPTH_BUFFER_BIT
         // Clear the screen (color and depth)
         glClear(GL_COLOR_BUFFER_BIT);
@@ -401,6 +406,11 @@ void mainLoop()
         glfwSwapBuffers(window);
         glfwPollEvents();
 
+        // frame time percentiles in the title
+        if (profiler.endFrame()) {
+            glfwSetWindowTitle(window, (string(TITLE) + " | " + profiler.summary()).c_str());
+        }
+
         // Clear the screen (color and depth)
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
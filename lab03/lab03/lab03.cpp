@@ -16,6 +16,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/profiler.h>
 #include <common/camera.h>
 #include <common/ModelLoader.h>
 #include <common/texture.h>
@@ -35,6 +36,7 @@ void free();
 
 // Global variables
 GLFWwindow* window;
+Profiler profiler;
 Camera* camera;
 GLuint shaderProgram;
 GLuint MVPLocation;
@@ -99,6 +101,7 @@ void free()
     glDeleteTextures(1, &texture);
     glDeleteVertexArrays(1, &suzanneVAO);
     glDeleteProgram(shaderProgram);
+    profiler.finish();
     glfwTerminate();
 }
 
@@ -107,6 +110,8 @@ void mainLoop()
 	unsigned int t = 0;
     do
     {
+        profiler.beginFrame();
+
         mat4 MVP, modelMatrix, viewMatrix, projectionMatrix;
 
         // Task 2: perspective projection
@@ -189,6 +194,11 @@ void mainLoop()
         glfwSwapBuffers(window);
         ++t;
         glfwPollEvents();
+
+        // frame time percentiles in the title
+        if (profiler.endFrame()) {
+            glfwSetWindowTitle(window, (string(TITLE) + " | " + profiler.summary()).c_str());
+        }
     } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
 }
@@ -16,6 +16,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/profiler.h>
 #include <common/camera.h>
 #include <common/ModelLoader.h>
 #include <common/texture.h>
@@ -36,6 +37,7 @@ void pollKeyboard(GLFWwindow* window, int key, int scancode, int action, int mod
 
 // Global variables
 GLFWwindow* window;
+Profiler profiler;
 Camera* camera;
 GLuint shaderProgram;
 GLuint MVPLocation, MLocation, planeLocation, detachmentCoeffLocation;
@@ -107,6 +109,7 @@ void free()
     glDeleteVertexArrays(1, &planeVAO);
 
     glDeleteProgram(shaderProgram);
+    profiler.finish();
     glfwTerminate();
 }
 
@@ -114,6 +117,8 @@ void mainLoop()
 {
     do
     {
+        profiler.beginFrame();
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(shaderProgram);
@@ -183,6 +188,11 @@ void mainLoop()
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        // frame time percentiles in the title
+        if (profiler.endFrame()) {
+            glfwSetWindowTitle(window, (string(TITLE) + " | " + profiler.summary()).c_str());
+        }
     } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
 }
@@ -0,0 +1,314 @@
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
+#include <cstddef>
+#include <tiny_obj_loader.h>
+#include "util.h"
+#include "texture.h"
+#include "uniforms.h"
+#include "Model.h"
+
+using namespace glm;
+using namespace std;
+
+namespace
+{
+    // interleaved vertex, 32 bytes
+    struct Vertex
+    {
+        vec3 position;
+        vec3 normal;
+        vec2 uv;
+    };
+
+    // a face corner of the .obj, corners with the same indices are one vertex
+    struct Corner
+    {
+        int v, t, n;
+
+        bool operator==(const Corner& other) const
+        {
+            return v == other.v && t == other.t && n == other.n;
+        }
+    };
+
+    struct CornerHash
+    {
+        size_t operator()(const Corner& c) const
+        {
+            size_t h = hash<int>()(c.v);
+            h ^= hash<int>()(c.t) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            h ^= hash<int>()(c.n) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    // opaque submeshes first, so blended ones are drawn over them, then by
+    // texture and material to keep the binds between draws to a minimum
+    struct SubmeshOrder
+    {
+        const vector<Material>& materials;
+
+        bool operator()(const Submesh& a, const Submesh& b) const
+        {
+            bool aBlended = materials[a.material].Kd.a < 1;
+            bool bBlended = materials[b.material].Kd.a < 1;
+            if (aBlended != bBlended) return bBlended;
+            if (a.texture != b.texture) return a.texture < b.texture;
+            return a.material < b.material;
+        }
+    };
+
+    string findTexture(const string& name, const string& baseDir)
+    {
+        if (fileExists(name)) return name;
+        if (fileExists(baseDir + name)) return baseDir + name;
+        return "";
+    }
+}
+
+Model::Model(const string& path, TextureCache& textures, GLuint materialBinding)
+{
+    tinyobj::attrib_t attrib;
+    vector<tinyobj::shape_t> shapes;
+    vector<tinyobj::material_t> mtl;
+
+    string baseDir = getBaseDir(path);
+    if (baseDir.empty())
+    {
+        baseDir = ".";
+    }
+#ifdef _WIN32
+    baseDir += "\\";
+#else
+    baseDir += "/";
+#endif
+
+    string err;
+    bool ret = tinyobj::LoadObj(&attrib, &shapes, &mtl, &err, path.c_str(),
+        baseDir.c_str());
+    if (!err.empty())
+    {
+        cout << err << endl;
+    }
+    if (!ret)
+    {
+        throw runtime_error("Failed to load " + path);
+    }
+
+    // .mtl materials, faces without a valid one use a gray default appended
+    // last
+    vector<GLuint> diffuseTextures;
+    for (const auto& m : mtl)
+    {
+        Material material{
+            vec4(m.ambient[0], m.ambient[1], m.ambient[2], 1),
+            vec4(m.diffuse[0], m.diffuse[1], m.diffuse[2], m.dissolve),
+            vec4(m.specular[0], m.specular[1], m.specular[2], 1),
+            m.shininess,
+            0
+        };
+
+        GLuint texture = 0;
+        if (!m.diffuse_texname.empty())
+        {
+            string file = findTexture(m.diffuse_texname, baseDir);
+            if (file.empty())
+            {
+                cout << "Unable to find texture: " << m.diffuse_texname << endl;
+            }
+            else
+            {
+                texture = textures.get(file);
+            }
+        }
+        material.useDiffuseTexture = texture != 0;
+
+        materials.push_back(material);
+        diffuseTextures.push_back(texture);
+    }
+    const int defaultMaterial = materials.size();
+    materials.push_back(Material{
+        vec4(0.1f, 0.1f, 0.1f, 1),
+        vec4(0.6f, 0.6f, 0.6f, 1),
+        vec4(0.2f, 0.2f, 0.2f, 1),
+        10.0f,
+        0 });
+    diffuseTextures.push_back(0);
+
+    // weld the corners into vertices and group the triangles by material
+    vector<Vertex> vertices;
+    vector<int> positions;  // of each vertex in attrib.vertices
+    bool missingNormals = false;
+    vector<vector<unsigned int>> groups(materials.size());
+    unordered_map<Corner, unsigned int, CornerHash> welded;
+    for (const auto& shape : shapes)
+    {
+        const tinyobj::mesh_t& mesh = shape.mesh;
+        for (size_t f = 0; f < mesh.indices.size() / 3; f++)
+        {
+            int material = f < mesh.material_ids.size() ? mesh.material_ids[f] : -1;
+            if (material < 0 || material >= defaultMaterial)
+            {
+                material = defaultMaterial;
+            }
+
+            for (int k = 0; k < 3; k++)
+            {
+                const tinyobj::index_t& index = mesh.indices[3 * f + k];
+                Corner corner = { index.vertex_index, index.texcoord_index,
+                    index.normal_index };
+
+                auto found = welded.find(corner);
+                if (found == welded.end())
+                {
+                    Vertex vertex;
+                    vertex.position = vec3(
+                        attrib.vertices[3 * corner.v + 0],
+                        attrib.vertices[3 * corner.v + 1],
+                        attrib.vertices[3 * corner.v + 2]);
+                    vertex.normal = corner.n < 0 ? vec3(0) : vec3(
+                        attrib.normals[3 * corner.n + 0],
+                        attrib.normals[3 * corner.n + 1],
+                        attrib.normals[3 * corner.n + 2]);
+                    vertex.uv = corner.t < 0 ? vec2(0) : vec2(
+                        attrib.texcoords[2 * corner.t + 0],
+                        1 - attrib.texcoords[2 * corner.t + 1]);
+
+                    missingNormals |= corner.n < 0;
+                    positions.push_back(corner.v);
+                    found = welded.insert(make_pair(corner,
+                        (unsigned int) vertices.size())).first;
+                    vertices.push_back(vertex);
+                }
+                groups[material].push_back(found->second);
+            }
+        }
+    }
+
+    // smooth normals for the vertices the file gives none, accumulated per
+    // position so that uv seams don't show
+    if (missingNormals)
+    {
+        vector<vec3> smoothNormals(attrib.vertices.size() / 3, vec3(0));
+        for (const auto& group : groups)
+        {
+            for (size_t i = 0; i < group.size(); i += 3)
+            {
+                const vec3& v0 = vertices[group[i + 0]].position;
+                const vec3& v1 = vertices[group[i + 1]].position;
+                const vec3& v2 = vertices[group[i + 2]].position;
+                // area weighted
+                vec3 faceNormal = cross(v1 - v0, v2 - v0);
+                for (int k = 0; k < 3; k++)
+                {
+                    smoothNormals[positions[group[i + k]]] += faceNormal;
+                }
+            }
+        }
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            vec3 normal = smoothNormals[positions[i]];
+            if (vertices[i].normal == vec3(0) && length(normal) > 0)
+            {
+                vertices[i].normal = normalize(normal);
+            }
+        }
+    }
+
+    // a submesh per used material, in draw order, and their indices one
+    // after the other
+    for (size_t m = 0; m < groups.size(); m++)
+    {
+        if (groups[m].empty()) continue;
+        Submesh submesh = { (int) m, diffuseTextures[m], 0,
+            (unsigned int) groups[m].size() };
+        submeshes.push_back(submesh);
+    }
+    sort(submeshes.begin(), submeshes.end(), SubmeshOrder{ materials });
+
+    vector<unsigned int> indices;
+    for (auto& submesh : submeshes)
+    {
+        submesh.firstIndex = indices.size();
+        const vector<unsigned int>& group = groups[submesh.material];
+        indices.insert(indices.end(), group.begin(), group.end());
+    }
+
+    minimum = vec3(numeric_limits<float>::max());
+    maximum = vec3(-numeric_limits<float>::max());
+    for (const auto& vertex : vertices)
+    {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+
+    cout << "Model " << path << ": " << vertices.size() << " vertices, "
+        << indices.size() / 3 << " triangles, " << submeshes.size()
+        << " submeshes, " << materials.size() - 1 << " materials" << endl;
+
+    // VAO
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    // interleaved vertex VBO
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
+        vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        (void*) offsetof(Vertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        (void*) offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+        (void*) offsetof(Vertex, uv));
+    glEnableVertexAttribArray(2);
+
+    // indices of all the submeshes
+    glGenBuffers(1, &EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+        indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+
+    // a block per material, selected with use() before each draw
+    materialBuffer = new UniformBuffer(materialBinding, sizeof(Material),
+        materials.size());
+    for (size_t m = 0; m < materials.size(); m++)
+    {
+        materialBuffer->update(materials[m], m);
+    }
+}
+
+Model::~Model()
+{
+    delete materialBuffer;
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+void Model::draw()
+{
+    glBindVertexArray(VAO);
+    glActiveTexture(GL_TEXTURE0);
+
+    // submeshes are sorted, so a texture is bound once per run
+    GLuint boundTexture = 0;
+    glBindTexture(GL_TEXTURE_2D, 0);
+    for (const auto& submesh : submeshes)
+    {
+        if (submesh.texture != boundTexture)
+        {
+            glBindTexture(GL_TEXTURE_2D, submesh.texture);
+            boundTexture = submesh.texture;
+        }
+        materialBuffer->use(submesh.material);
+        glDrawElements(GL_TRIANGLES, submesh.count, GL_UNSIGNED_INT,
+            (void*) (submesh.firstIndex * sizeof(unsigned int)));
+    }
+}
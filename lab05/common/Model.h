@@ -0,0 +1,69 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+class TextureCache;
+class UniformBuffer;
+
+/**
+* std140 layout of the MaterialBlock of the shaders. Kd.a is the dissolve (d)
+* of the .mtl, useDiffuseTexture is 1 when the diffuse color is modulated by
+* the texture (map_Kd) bound on unit 0.
+*/
+struct Material
+{
+    glm::vec4 Ka;
+    glm::vec4 Kd;
+    glm::vec4 Ks;
+    float Ns;
+    int useDiffuseTexture;
+};
+
+/**
+* The faces of a Model that share a material, a range of its index buffer.
+*/
+struct Submesh
+{
+    int material;        // block of the model's material buffer
+    GLuint texture;      // diffuse texture, 0 if none
+    unsigned int firstIndex, count;
+};
+
+/**
+* A multi-material .obj model (core profile). The .mtl materials are parsed
+* into one uniform buffer, the faces are grouped into a submesh per material
+* and the submeshes are sorted by texture and then by material, so draw()
+* rebinds a texture only when it changes. Every submesh shares one VAO with
+* an interleaved vertex buffer (position at 0, normal at 1, uv at 2) and an
+* index buffer. The textures are taken from a TextureCache, so models that
+* share a texture load it once.
+*
+* https://github.com/syoyo/tinyobjloader
+*/
+class Model
+{
+public:
+    /* Load path and its .mtl, materialBinding is the MaterialBlock binding */
+    Model(const std::string& path, TextureCache& textures, GLuint materialBinding);
+    ~Model();
+
+    /* Bind the VAO and draw every submesh with its material and texture */
+    void draw();
+
+    std::vector<Material> materials;
+    std::vector<Submesh> submeshes;
+    glm::vec3 minimum, maximum;
+
+private:
+    Model(const Model&);
+    Model& operator=(const Model&);
+
+    GLuint VAO, VBO, EBO;
+    UniformBuffer* materialBuffer;
+};
+
+#endif
@@ -1,10 +1,12 @@
 #include <iostream>
 #include <sstream>
 #include <tinyxml2.h>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
 #include "util.h"
 #include "ModelLoader.h"
+// after ModelLoader.h, which includes tiny_obj_loader.h without it when
+// MODEL_LOADER_EXPERIMENTAL is 1
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
 
 using namespace glm;
 using namespace std;
@@ -366,6 +368,22 @@ void Drawable::draw()
 
 #include "texture.h"
 #include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <glm/gtc/packing.hpp>
+
+/*
+* The vertex format of a DrawObject, 24 bytes instead of the 44 of
+* pos(3float), normal(3float), color(3float), texcoord(2float).
+*/
+struct PackedVertex
+{
+    float position[3];
+    uint32_t normal;  // GL_INT_2_10_10_10_REV
+    uint32_t color;   // 4 normalized GL_UNSIGNED_BYTE
+    uint32_t uv;      // 2 GL_HALF_FLOAT
+};
 
 void loadObjAndConvert(const char* filename,
     vector<DrawObject>& drawObjects,
@@ -484,7 +502,7 @@ void loadObjAndConvert(const char* filename,
         for (size_t s = 0; s < shapes.size(); s++)
         {
             DrawObject o;
-            vector<float> buffer;  // pos(3float), normal(3float), color(3float)
+            vector<PackedVertex> buffer;
             for (size_t f = 0; f < shapes[s].mesh.indices.size() / 3; f++)
             {
                 tinyobj::index_t idx0 = shapes[s].mesh.indices[3 * f + 0];
@@ -584,12 +602,10 @@ void loadObjAndConvert(const char* filename,
 
                 for (int k = 0; k < 3; k++)
                 {
-                    buffer.push_back(v[k][0]);
-                    buffer.push_back(v[k][1]);
-                    buffer.push_back(v[k][2]);
-                    buffer.push_back(n[k][0]);
-                    buffer.push_back(n[k][1]);
-                    buffer.push_back(n[k][2]);
+                    PackedVertex vertex;
+                    memcpy(vertex.position, v[k], sizeof(vertex.position));
+                    vertex.normal = packSnorm3x10_1x2(
+                        vec4(n[k][0], n[k][1], n[k][2], 0.0f));
                     // Combine normal and diffuse to get color.
                     float normal_factor = 0.2;
                     float diffuse_factor = 1 - normal_factor;
@@ -607,21 +623,20 @@ void loadObjAndConvert(const char* filename,
                         c[1] /= len;
                         c[2] /= len;
                     }
-                    buffer.push_back(c[0] * 0.5 + 0.5);
-                    buffer.push_back(c[1] * 0.5 + 0.5);
-                    buffer.push_back(c[2] * 0.5 + 0.5);
-
-                    buffer.push_back(tc[k][0]);
-                    buffer.push_back(tc[k][1]);
+                    vertex.color = packUnorm4x8(vec4(
+                        c[0] * 0.5 + 0.5, c[1] * 0.5 + 0.5, c[2] * 0.5 + 0.5, 1.0f));
+                    vertex.uv = packHalf2x16(vec2(tc[k][0], tc[k][1]));
+                    buffer.push_back(vertex);
                 }
             }
 
+            o.vao = 0;
             o.vb_id = 0;
             o.numTriangles = 0;
 
             // OpenGL viewer does not support texturing with per-face material.
             if (shapes[s].mesh.material_ids.size() > 0 &&
-                shapes[s].mesh.material_ids.size() > s)
+                shapes[s].mesh.material_ids[0] >= 0)
             {
                 // use the material ID of the first face.
                 o.material_id = shapes[s].mesh.material_ids[0];
@@ -632,12 +647,30 @@ void loadObjAndConvert(const char* filename,
             printf("shape[%d] material_id %d\n", int(s), int(o.material_id));
 
             if (buffer.size() > 0) {
+                glGenVertexArrays(1, &o.vao);
+                glBindVertexArray(o.vao);
+
                 glGenBuffers(1, &o.vb_id);
                 glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
-                glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(float), &buffer.at(0),
-                    GL_STATIC_DRAW);
-                // 3:vtx, 3:normal, 3:col, 2:texcoord
-                o.numTriangles = buffer.size() / (3 + 3 + 3 + 2) / 3;
+                glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(PackedVertex),
+                    &buffer.at(0), GL_STATIC_DRAW);
+                // 0:vtx, 1:normal, 2:texcoord, 3:col
+                GLsizei stride = sizeof(PackedVertex);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                    (const void*)offsetof(PackedVertex, position));
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                    (const void*)offsetof(PackedVertex, normal));
+                glEnableVertexAttribArray(1);
+                glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+                    (const void*)offsetof(PackedVertex, uv));
+                glEnableVertexAttribArray(2);
+                glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                    (const void*)offsetof(PackedVertex, color));
+                glEnableVertexAttribArray(3);
+                glBindVertexArray(0);
+
+                o.numTriangles = buffer.size() / 3;
 
                 printf("shape[%d] # of triangles = %d\n", static_cast<int>(s),
                     o.numTriangles);
@@ -653,73 +686,46 @@ void loadObjAndConvert(const char* filename,
 
 void draw(const vector<DrawObject>& drawObjects,
     const vector<tinyobj::material_t>& materials,
-    const map<string, GLuint>& textures)
+    const map<string, GLuint>& textures,
+    GLuint useTextureLocation)
 {
-    glPolygonMode(GL_FRONT, GL_FILL);
-    glPolygonMode(GL_BACK, GL_FILL);
-
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    glPolygonOffset(1.0, 1.0);
-    GLsizei stride = (3 + 3 + 3 + 2) * sizeof(float);
+    glActiveTexture(GL_TEXTURE0);
     for (size_t i = 0; i < drawObjects.size(); i++)
     {
-        DrawObject o = drawObjects[i];
+        const DrawObject& o = drawObjects[i];
         if (o.vb_id < 1)
         {
             continue;
         }
 
-        glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glEnableClientState(GL_NORMAL_ARRAY);
-        glEnableClientState(GL_COLOR_ARRAY);
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLuint texture = 0;
         if ((o.material_id < materials.size()))
         {
-            string diffuse_texname = materials[o.material_id].diffuse_texname;
-            if (textures.find(diffuse_texname) != textures.end())
+            map<string, GLuint>::const_iterator found =
+                textures.find(materials[o.material_id].diffuse_texname);
+            if (found != textures.end())
             {
-                glBindTexture(GL_TEXTURE_2D, textures.at(diffuse_texname));
+                texture = found->second;
             }
         }
-        glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
-        glNormalPointer(GL_FLOAT, stride, (const void*)(sizeof(float) * 3));
-        glColorPointer(3, GL_FLOAT, stride, (const void*)(sizeof(float) * 6));
-        glTexCoordPointer(2, GL_FLOAT, stride, (const void*)(sizeof(float) * 9));
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glUniform1i(useTextureLocation, texture != 0);
 
+        // fill and wireframe in one pass, see Wireframe.fragmentshader
+        glBindVertexArray(o.vao);
         glDrawArrays(GL_TRIANGLES, 0, 3 * o.numTriangles);
-        checkErrors("drawarrays");
-        glBindTexture(GL_TEXTURE_2D, 0);
+        CHECK_GL_ERRORS("drawarrays");
     }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-    // draw wireframe
-    glDisable(GL_POLYGON_OFFSET_FILL);
-    glPolygonMode(GL_FRONT, GL_LINE);
-    glPolygonMode(GL_BACK, GL_LINE);
-
-    glColor3f(0.0f, 0.0f, 0.4f);
+void deleteDrawObjects(vector<DrawObject>& drawObjects)
+{
     for (size_t i = 0; i < drawObjects.size(); i++)
     {
-        DrawObject o = drawObjects[i];
-        if (o.vb_id < 1)
-        {
-            continue;
-        }
-
-        glBindBuffer(GL_ARRAY_BUFFER, o.vb_id);
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glEnableClientState(GL_NORMAL_ARRAY);
-        glDisableClientState(GL_COLOR_ARRAY);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-        glVertexPointer(3, GL_FLOAT, stride, (const void*)0);
-        glNormalPointer(GL_FLOAT, stride, (const void*)(sizeof(float) * 3));
-        glColorPointer(3, GL_FLOAT, stride, (const void*)(sizeof(float) * 6));
-        glTexCoordPointer(2, GL_FLOAT, stride, (const void*)(sizeof(float) * 9));
-
-        glDrawArrays(GL_TRIANGLES, 0, 3 * o.numTriangles);
-        checkErrors("drawarrays");
+        glDeleteBuffers(1, &drawObjects[i].vb_id);
+        glDeleteVertexArrays(1, &drawObjects[i].vao);
     }
+    drawObjects.clear();
 }
 #endif
\ No newline at end of file
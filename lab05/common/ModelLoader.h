@@ -59,7 +59,7 @@ public:
 
 /*****************************Experimental************************************/
 
-#define MODEL_LOADER_EXPERIMENTAL 0
+#define MODEL_LOADER_EXPERIMENTAL 1
 
 #if MODEL_LOADER_EXPERIMENTAL == 1
 #include <tiny_obj_loader.h>
@@ -68,9 +68,14 @@ public:
 /**
 * https://github.com/syoyo/tinyobjloader/blob/master/examples/viewer/viewer.cc
 *
+* A core profile port of the viewer: each shape is a VAO over a non-indexed
+* buffer of packed vertices (position, 2_10_10_10 normal, half float uv and
+* 8 bit color; 24 bytes). Draw with the Wireframe shaders, which overlay the
+* wireframe on the fill in the same pass.
 */
 typedef struct
 {
+    GLuint vao;
     GLuint vb_id;  // vertex buffer id
     int numTriangles;
     size_t material_id;
@@ -82,9 +87,13 @@ void loadObjAndConvert(const char* filename,
     std::map<std::string, GLuint>& textures,
     float bmin[3], float bmax[3]);
 
+/* useTextureLocation of the bound program is set per object */
 void draw(const std::vector<DrawObject>& drawObjects,
     const std::vector<tinyobj::material_t>& materials,
-    const std::map<std::string, GLuint>& textures);
+    const std::map<std::string, GLuint>& textures,
+    GLuint useTextureLocation);
+
+void deleteDrawObjects(std::vector<DrawObject>& drawObjects);
 
 #endif
 
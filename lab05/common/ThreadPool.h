@@ -0,0 +1,80 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+
+/**
+* A fixed set of worker threads that run queued tasks. Tasks must not touch
+* the OpenGL context, it is current only on the main thread.
+*/
+class ThreadPool {
+public:
+    ThreadPool(unsigned int threads = std::thread::hardware_concurrency()) : stop(false) {
+        if (threads == 0) threads = 1;
+        for (unsigned int i = 0; i < threads; i++) {
+            workers.push_back(std::thread(&ThreadPool::work, this));
+        }
+    }
+
+    /* Wait for the queued tasks to finish and join the workers */
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    /* Queue a task, its result (or exception) is delivered by the future */
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> submit(F task) {
+        typedef typename std::result_of<F()>::type R;
+        std::shared_ptr<std::packaged_task<R()> > packaged(
+            new std::packaged_task<R()>(task));
+        std::future<R> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push([packaged]() { (*packaged)(); });
+        }
+        condition.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stop || !tasks.empty(); });
+                if (stop && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stop;
+};
+
+#endif
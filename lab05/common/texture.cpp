@@ -3,6 +3,11 @@
 #include <SOIL/SOIL.h>
 #include <string.h>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include "ThreadPool.h"
 #include "texture.h"
 using namespace std;
 
@@ -244,4 +249,285 @@ GLuint loadSOIL(const char* imagePath)
     }
 
     return texture;
-}
\ No newline at end of file
+}
+
+TextureCache::~TextureCache()
+{
+    for (const auto& texture : textures)
+    {
+        glDeleteTextures(1, &texture.second);
+    }
+}
+
+GLuint TextureCache::get(const string& path)
+{
+    map<string, GLuint>::const_iterator found = textures.find(path);
+    if (found != textures.end())
+    {
+        return found->second;
+    }
+
+    // failures are remembered too, so they are reported once
+    GLuint texture = streamer != NULL ? streamer->request(path) :
+        loadSOIL(path.c_str());
+    textures[path] = texture;
+    return texture;
+}
+
+TextureStreamer::TextureStreamer(size_t budget, unsigned int threads,
+    int pboCount, size_t pboSize)
+    : pool(new ThreadPool(threads)), next(0), pboSize(pboSize), budget(budget),
+    resident(0), requested(0)
+{
+    ring.resize(max(pboCount, 1));
+    for (auto& pbo : ring)
+    {
+        glGenBuffers(1, &pbo.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, pboSize, NULL, GL_STREAM_DRAW);
+        pbo.size = pboSize;
+        pbo.fence = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    // waits for the decodes in flight
+    delete pool;
+
+    for (auto& pbo : ring)
+    {
+        if (pbo.fence != 0)
+        {
+            glDeleteSync(pbo.fence);
+        }
+        glDeleteBuffers(1, &pbo.buffer);
+    }
+}
+
+GLuint TextureStreamer::request(const string& path)
+{
+    // a gray placeholder until the mip tail arrives
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    const unsigned char gray[] = { 128, 128, 128, 255 };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+        gray);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Stream s;
+    s.texture = texture;
+    s.path = path;
+    s.decoding = pool->submit([path]() { return decode(path); });
+    s.level = 0;
+    s.row = 0;
+    streams.push_back(move(s));
+
+    return texture;
+}
+
+shared_ptr<TextureStreamer::Image> TextureStreamer::decode(const string& path)
+{
+    shared_ptr<Image> image(new Image);
+
+    int width, height, channels;
+    unsigned char* data = SOIL_load_image(path.c_str(), &width, &height,
+        &channels, SOIL_LOAD_RGBA);
+    if (data == NULL)
+    {
+        return image;
+    }
+
+    Level base;
+    base.width = width;
+    base.height = height;
+    base.pixels.assign(data, data + (size_t) width * height * 4);
+    SOIL_free_image_data(data);
+    image->levels.push_back(move(base));
+
+    // box filtered mip chain down to 1x1, what glGenerateMipmap would make,
+    // so that the small levels can be uploaded before the full image
+    while (image->levels.back().width > 1 || image->levels.back().height > 1)
+    {
+        const Level& src = image->levels.back();
+        Level dst;
+        dst.width = max(src.width / 2, 1);
+        dst.height = max(src.height / 2, 1);
+        dst.pixels.resize((size_t) dst.width * dst.height * 4);
+        for (int y = 0; y < dst.height; y++)
+        {
+            int y0 = min(2 * y, src.height - 1), y1 = min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++)
+            {
+                int x0 = min(2 * x, src.width - 1), x1 = min(2 * x + 1, src.width - 1);
+                const unsigned char* p00 = &src.pixels[4 * ((size_t) y0 * src.width + x0)];
+                const unsigned char* p01 = &src.pixels[4 * ((size_t) y0 * src.width + x1)];
+                const unsigned char* p10 = &src.pixels[4 * ((size_t) y1 * src.width + x0)];
+                const unsigned char* p11 = &src.pixels[4 * ((size_t) y1 * src.width + x1)];
+                unsigned char* out = &dst.pixels[4 * ((size_t) y * dst.width + x)];
+                for (int c = 0; c < 4; c++)
+                {
+                    out[c] = (p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4;
+                }
+            }
+        }
+        image->levels.push_back(move(dst));
+    }
+
+    return image;
+}
+
+void TextureStreamer::update(size_t maxBytes)
+{
+    size_t uploaded = 0;
+    bool ringFull = false;
+    while (uploaded < maxBytes && !ringFull)
+    {
+        // the stream with the smallest level to go, so that every texture
+        // gets its mip tail before any gets its full image
+        Stream* smallest = NULL;
+        size_t smallestBytes = 0;
+        for (auto& s : streams)
+        {
+            if (s.level < 0)
+            {
+                continue;
+            }
+            if (!s.image)
+            {
+                if (s.decoding.wait_for(chrono::seconds(0)) != future_status::ready)
+                {
+                    continue;
+                }
+                s.image = s.decoding.get();
+                if (s.image->levels.empty())
+                {
+                    cout << "Texture streaming error, can't decode: " << s.path << endl;
+                    s.image.reset();
+                    s.level = -1;
+                    continue;
+                }
+                for (const auto& level : s.image->levels)
+                {
+                    requested += level.pixels.size();
+                }
+                s.level = s.image->levels.size() - 1;
+                s.row = 0;
+            }
+
+            size_t bytes = s.image->levels[s.level].pixels.size();
+            if (smallest == NULL || bytes < smallestBytes)
+            {
+                smallest = &s;
+                smallestBytes = bytes;
+            }
+        }
+        if (smallest == NULL)
+        {
+            break;
+        }
+        ringFull = !uploadRows(*smallest, uploaded);
+    }
+
+    streams.erase(remove_if(streams.begin(), streams.end(),
+        [](const Stream& s) { return s.level < 0; }), streams.end());
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool TextureStreamer::uploadRows(Stream& s, size_t& uploaded)
+{
+    const Level& level = s.image->levels[s.level];
+    size_t rowBytes = (size_t) level.width * 4;
+
+    // a level over the budget leaves the texture at the coarser ones
+    if (s.row == 0 && resident + level.pixels.size() > budget)
+    {
+        s.image.reset();
+        s.level = -1;
+        return true;
+    }
+
+    // the ring came round to a buffer the GPU may still be reading from; this
+    // is checked before a new level is allocated, so a level that has to wait
+    // for the next frame is not allocated and counted twice
+    PixelBuffer& pbo = ring[next];
+    if (pbo.fence != 0)
+    {
+        if (glClientWaitSync(pbo.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            return false;
+        }
+        glDeleteSync(pbo.fence);
+        pbo.fence = 0;
+    }
+
+    if (s.row == 0)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, s.texture);
+        glTexImage2D(GL_TEXTURE_2D, s.level, GL_RGBA8, level.width, level.height,
+            0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        resident += level.pixels.size();
+    }
+
+    // as many rows as fit in a buffer, at least one
+    int rows = max((int) (pboSize / rowBytes), 1);
+    rows = min(rows, level.height - s.row);
+    size_t bytes = rows * rowBytes;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.buffer);
+    if (bytes > pbo.size)
+    {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        pbo.size = bytes;
+    }
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    memcpy(mapped, &level.pixels[s.row * rowBytes], bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, s.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, s.level, 0, s.row, level.width, rows,
+        GL_RGBA, GL_UNSIGNED_BYTE, (const void*) 0);
+    pbo.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next = (next + 1) % ring.size();
+
+    uploaded += bytes;
+    s.row += rows;
+
+    // a complete level becomes the finest one sampled
+    if (s.row == level.height)
+    {
+        if (s.level == (int) s.image->levels.size() - 1)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, s.level);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, s.level);
+        s.level--;
+        s.row = 0;
+        if (s.level < 0)
+        {
+            s.image.reset();
+        }
+    }
+    return true;
+}
+
+string TextureStreamer::summary() const
+{
+    ostringstream out;
+    out << fixed << setprecision(1) << "textures "
+        << resident / (1024.0 * 1024.0) << "/"
+        << requested / (1024.0 * 1024.0) << " MB";
+    return out.str();
+}
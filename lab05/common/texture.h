@@ -2,6 +2,13 @@
 #define TEXTURE_H
 
 #include <GL/glew.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <future>
+#include <memory>
+
+class ThreadPool;
 
 /**
 * A simple .bmp loader. Use loadSOIL() instead.
@@ -28,4 +35,118 @@ GLuint loadDDS(const char* imagePath);
 */
 GLuint loadSOIL(const char* imagePath);
 
+class TextureStreamer;
+
+/**
+* Textures loaded with loadSOIL() by path, so a texture shared by several
+* materials or models is read and uploaded once. With a streamer they are
+* requested from it instead and get() doesn't block. The cache owns them,
+* delete it while the context is still current.
+*/
+class TextureCache
+{
+public:
+    TextureCache(TextureStreamer* streamer = NULL) : streamer(streamer) {}
+    ~TextureCache();
+
+    /* The texture of path, loaded on the first request, 0 if it can't be */
+    GLuint get(const std::string& path);
+
+    size_t size() const { return textures.size(); }
+
+private:
+    TextureCache(const TextureCache&);
+    TextureCache& operator=(const TextureCache&);
+
+    TextureStreamer* streamer;
+    std::map<std::string, GLuint> textures;
+};
+
+/**
+* Loads textures without stalling the render thread. request() returns a
+* texture at once, a 1x1 gray placeholder; the image is decoded and its mip
+* chain built on worker threads, and update() uploads the levels through a
+* ring of pixel buffer objects, smallest first across all textures, moving
+* GL_TEXTURE_BASE_LEVEL down as each finer level arrives. So rendering
+* starts with blurry textures that sharpen over the next frames.
+*
+* Levels are uploaded while the resident bytes stay within the budget, the
+* finer levels of a texture that doesn't fit are dropped and it stays at a
+* coarser mip. The caller owns the textures, like those of loadSOIL().
+*/
+class TextureStreamer
+{
+public:
+    /* pboCount buffers of pboSize bytes, budget bytes of resident levels */
+    TextureStreamer(size_t budget = 256 << 20, unsigned int threads = 2,
+        int pboCount = 4, size_t pboSize = 4 << 20);
+    ~TextureStreamer();
+
+    /* Start loading path, the texture is usable right away */
+    GLuint request(const std::string& path);
+
+    /*
+    * Upload up to maxBytes of decoded levels, call once per frame. Leaves 0
+    * bound to GL_TEXTURE_2D and GL_PIXEL_UNPACK_BUFFER.
+    */
+    void update(size_t maxBytes = 8 << 20);
+
+    /* Only limits the uploads that follow */
+    void setBudget(size_t bytes) { budget = bytes; }
+    size_t getBudget() const { return budget; }
+
+    /* Bytes of the uploaded levels */
+    size_t residentBytes() const { return resident; }
+    /* Bytes of the full mip chains of the decoded textures */
+    size_t requestedBytes() const { return requested; }
+    /* True while decodes or uploads are pending */
+    bool busy() const { return !streams.empty(); }
+
+    /* "textures resident/requested MB" for a window title */
+    std::string summary() const;
+
+private:
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer& operator=(const TextureStreamer&);
+
+    struct Level
+    {
+        int width, height;
+        std::vector<unsigned char> pixels;  // RGBA
+    };
+
+    struct Image
+    {
+        std::vector<Level> levels;  // levels[0] is the full image
+    };
+
+    struct Stream
+    {
+        GLuint texture;
+        std::string path;
+        std::future<std::shared_ptr<Image> > decoding;
+        std::shared_ptr<Image> image;
+        int level;  // being uploaded, counts down to 0
+        int row;    // next row of level
+    };
+
+    struct PixelBuffer
+    {
+        GLuint buffer;
+        size_t size;
+        GLsync fence;  // of the last upload from it
+    };
+
+    static std::shared_ptr<Image> decode(const std::string& path);
+    /* Upload the next rows of s, false when the ring is busy */
+    bool uploadRows(Stream& s, size_t& uploaded);
+
+    ThreadPool* pool;
+    std::vector<Stream> streams;
+    std::vector<PixelBuffer> ring;
+    int next;
+    size_t pboSize;
+    size_t budget, resident, requested;
+};
+
 #endif
\ No newline at end of file
@@ -57,4 +57,15 @@ void calcNormal(const float v0[3], const float v1[3], const float v2[3], float N
 */
 void checkErrors(std::string desc);
 
+/**
+* checkErrors() for per-draw checks, compiled out of release (NDEBUG) builds:
+* glGetError() waits for the commands before it, once per draw it serializes
+* the driver.
+*/
+#ifdef NDEBUG
+#define CHECK_GL_ERRORS(desc)
+#else
+#define CHECK_GL_ERRORS(desc) checkErrors(desc)
+#endif
+
 #endif
\ No newline at end of file
@@ -17,9 +17,12 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/profiler.h>
 #include <common/camera.h>
 #include <common/ModelLoader.h>
+#include <common/Model.h>
 #include <common/texture.h>
+#include <common/uniforms.h>
 
 using namespace std;
 using namespace glm;
@@ -36,10 +39,12 @@ void free();
 
 // Global variables
 GLFWwindow* window;
+Profiler profiler;
 Camera* camera;
 GLuint shaderProgram;
-GLuint projectionMatrixLocation, viewMatrixLocation, modelMatrixLocation;
-GLuint lightLocation;
+GLuint modelMatrixLocation;
+// P and V, the light and the material are std140 uniform blocks
+UniformBuffer *cameraBuffer, *lightBuffer, *materialBuffer;
 GLuint diffuceColorSampler, specularColorSampler;
 GLuint diffuseTexture, specularTexture;
 GLuint objVAO, triangleVAO;
@@ -47,8 +52,57 @@ GLuint objVerticiesVBO, objUVVBO, objNormalsVBO;
 GLuint triangleVerticesVBO, triangleNormalsVBO;
 std::vector<vec3> objVertices, objNormals;
 std::vector<vec2> objUVs;
+// .obj with its .mtl materials, drawn when RENDER_MODEL is 1
+TextureStreamer* textureStreamer;
+TextureCache* textures;
+Model* model;
+// the same .obj as tinyobj DrawObjects with a wireframe overlay, drawn when
+// RENDER_DRAW_OBJECTS is 1 (needs MODEL_LOADER_EXPERIMENTAL in ModelLoader.h)
+GLuint wireframeProgram;
+GLuint wireframeModelMatrixLocation, useTextureLocation;
+std::vector<DrawObject> drawObjects;
+std::vector<tinyobj::material_t> drawObjectMaterials;
+std::map<std::string, GLuint> drawObjectTextures;
 
 #define RENDER_TRIANGLE 1
+#define RENDER_MODEL 0
+#define RENDER_DRAW_OBJECTS 0
+#define MODEL_PATH "suzanne.obj"
+
+// Uniform buffer binding points
+enum UniformBinding {
+    CAMERA_BINDING = 0, LIGHT_BINDING, MATERIAL_BINDING
+};
+
+// std140 layout of the uniform blocks
+struct CameraBlock {
+    mat4 V;
+    mat4 P;
+};
+
+struct Light {
+    vec4 La;
+    vec4 Ld;
+    vec4 Ls;
+    vec3 lightPosition_worldspace;
+    float power;
+};
+
+Light light{
+    vec4{ 1, 1, 1, 1 },
+    vec4{ 1, 1, 1, 1 },
+    vec4{ 1, 1, 1, 1 },
+    vec3{ 0, 0, 4 },
+    1.0f
+};
+
+// http://www.barradeau.com/nicoptere/dump/materials.html
+const Material gold{
+    vec4{ 0.24725, 0.1995, 0.0745, 1 },
+    vec4{ 0.75164, 0.60648, 0.22648, 1 },
+    vec4{ 0.628281, 0.555802, 0.366065, 1 },
+    51.2f
+};
 
 void createContext()
 {
@@ -73,10 +127,40 @@ void createContext()
     specularColorSampler = glGetUniformLocation(shaderProgram, "specularColorSampler");
 
     // get pointers to the uniform variables
-    projectionMatrixLocation = glGetUniformLocation(shaderProgram, "P");
-    viewMatrixLocation = glGetUniformLocation(shaderProgram, "V");
     modelMatrixLocation = glGetUniformLocation(shaderProgram, "M");
-    lightLocation = glGetUniformLocation(shaderProgram, "light_position_worldspace");
+
+    // uniform blocks; the material does not change, so it is uploaded once
+    UniformBuffer::bindBlock(shaderProgram, "CameraBlock", CAMERA_BINDING);
+    UniformBuffer::bindBlock(shaderProgram, "LightBlock", LIGHT_BINDING);
+    UniformBuffer::bindBlock(shaderProgram, "MaterialBlock", MATERIAL_BINDING);
+    cameraBuffer = new UniformBuffer(CAMERA_BINDING, sizeof(CameraBlock));
+    lightBuffer = new UniformBuffer(LIGHT_BINDING, sizeof(Light));
+    materialBuffer = new UniformBuffer(MATERIAL_BINDING, sizeof(Material));
+    materialBuffer->update(gold);
+
+#if RENDER_MODEL == 1
+    // each material of the model is a block of its own material buffer, its
+    // textures stream in over the first frames
+    textureStreamer = new TextureStreamer();
+    textures = new TextureCache(textureStreamer);
+    model = new Model(MODEL_PATH, *textures, MATERIAL_BINDING);
+#endif
+
+#if RENDER_DRAW_OBJECTS == 1
+    wireframeProgram = loadShaders(
+        "Wireframe.vertexshader",
+        "Wireframe.fragmentshader");
+    UniformBuffer::bindBlock(wireframeProgram, "CameraBlock", CAMERA_BINDING);
+    wireframeModelMatrixLocation = glGetUniformLocation(wireframeProgram, "M");
+    useTextureLocation = glGetUniformLocation(wireframeProgram, "useTexture");
+    // draw() binds the diffuse textures to unit 0
+    glUseProgram(wireframeProgram);
+    glUniform1i(glGetUniformLocation(wireframeProgram, "diffuseColorSampler"), 0);
+
+    float bmin[3], bmax[3];
+    loadObjAndConvert(MODEL_PATH, drawObjects, drawObjectMaterials,
+        drawObjectTextures, bmin, bmax);
+#endif
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
@@ -158,16 +242,31 @@ void free()
     glDeleteVertexArrays(1, &objVAO);
 
     glDeleteTextures(1, &diffuseTexture);
+    delete model;
+#if RENDER_DRAW_OBJECTS == 1
+    deleteDrawObjects(drawObjects);
+    for (auto& texture : drawObjectTextures)
+    {
+        glDeleteTextures(1, &texture.second);
+    }
+    glDeleteProgram(wireframeProgram);
+#endif
+    delete textures;
+    delete textureStreamer;
+    delete cameraBuffer;
+    delete lightBuffer;
+    delete materialBuffer;
     glDeleteProgram(shaderProgram);
+    profiler.finish();
     glfwTerminate();
 }
 
 void mainLoop()
 {
-    glm::vec3 lightPos = glm::vec3(0, 0, 4);
-
     do
     {
+        profiler.beginFrame();
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(shaderProgram);
@@ -186,10 +285,9 @@ void mainLoop()
         glm::mat4 modelMatrix = glm::mat4(1.0);
 
         // Task 1.4c: transfer uniforms to GPU
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
-        glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
+        cameraBuffer->update(CameraBlock{ viewMatrix, projectionMatrix });
+        lightBuffer->update(light);
         glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &modelMatrix[0][0]);
-        glUniform3f(lightLocation, lightPos.x, lightPos.y, lightPos.z); // light
 
         // Task 6.4: bind textures and transmit diffuse and specular maps to the GPU
         /*/
@@ -203,7 +301,14 @@ void mainLoop()
         //*/
 
         // draw
-#if RENDER_TRIANGLE == 1
+#if RENDER_DRAW_OBJECTS == 1
+        glUseProgram(wireframeProgram);
+        glUniformMatrix4fv(wireframeModelMatrixLocation, 1, GL_FALSE, &modelMatrix[0][0]);
+        draw(drawObjects, drawObjectMaterials, drawObjectTextures, useTextureLocation);
+#elif RENDER_MODEL == 1
+        textureStreamer->update();
+        model->draw();
+#elif RENDER_TRIANGLE == 1
         glDrawArrays(GL_TRIANGLES, 0, 3);
 #else
         glDrawArrays(GL_TRIANGLES, 0, objVertices.size());
@@ -212,6 +317,15 @@ void mainLoop()
         glfwSwapBuffers(window);
 
         glfwPollEvents();
+
+        // frame time percentiles in the title
+        if (profiler.endFrame()) {
+            string title = string(TITLE) + " | " + profiler.summary();
+#if RENDER_MODEL == 1
+            title += " | " + textureStreamer->summary();
+#endif
+            glfwSetWindowTitle(window, title.c_str());
+        }
     } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
 }
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <sstream>
-#include <map>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
 #include <tinyxml2.h>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
@@ -290,29 +292,130 @@ struct PackedVertex
     glm::vec3 position;
     glm::vec2 uv;
     glm::vec3 normal;
-    bool operator<(const PackedVertex that) const
+};
+
+/**
+* The key under which a PackedVertex is welded. In exact mode it holds the raw
+* bits of the 8 floats, so two vertices are welded only if they are bitwise
+* equal. In quantized mode every component is snapped to a grid of size
+* epsilon before comparison.
+*/
+struct WeldKey
+{
+    uint32_t v[8];
+
+    bool operator==(const WeldKey& that) const
     {
-        return memcmp((void*)this, (void*)&that, sizeof(PackedVertex)) > 0;
-    };
+        return memcmp(v, that.v, sizeof(v)) == 0;
+    }
 };
 
-bool getSimilarVertexIndex(
-    PackedVertex& packed,
-    map<PackedVertex, unsigned int>& vertexToOutIndex,
-    unsigned int& result)
+/* Grid cell of f, clamped to the int32_t range (NaN goes to the lowest cell) */
+static uint32_t quantize(float f, float epsilon)
+{
+    double cell = floor((double)f / epsilon + 0.5);
+    if (!(cell >= INT32_MIN)) cell = INT32_MIN;
+    if (cell > INT32_MAX) cell = INT32_MAX;
+    return (uint32_t)(int32_t)cell;
+}
+
+static WeldKey makeWeldKey(const PackedVertex& packed, float epsilon)
 {
-    map<PackedVertex, unsigned int>::iterator it = vertexToOutIndex.find(packed);
-    if (it == vertexToOutIndex.end())
+    const float f[8] = {
+        packed.position.x, packed.position.y, packed.position.z,
+        packed.uv.x, packed.uv.y,
+        packed.normal.x, packed.normal.y, packed.normal.z };
+    WeldKey key;
+    if (epsilon > 0.0f)
     {
-        return false;
+        for (int i = 0; i < 8; i++)
+        {
+            key.v[i] = quantize(f[i], epsilon);
+        }
     }
     else
     {
-        result = it->second;
-        return true;
+        memcpy(key.v, f, sizeof(f));
     }
+    return key;
 }
 
+static uint32_t hashWeldKey(const WeldKey& key)
+{
+    // murmur3 style mixing of the 8 words
+    uint32_t h = 0x9e3779b9u;
+    for (int i = 0; i < 8; i++)
+    {
+        uint32_t k = key.v[i] * 0xcc9e2d51u;
+        k = (k << 15) | (k >> 17);
+        h ^= k * 0x1b873593u;
+        h = ((h << 13) | (h >> 19)) * 5 + 0xe6546b64u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static const unsigned int EMPTY_SLOT = 0xffffffffu;
+
+/**
+* Open addressing (linear probing) hash table that maps a vertex to its index
+* in the output arrays of indexVBO(). The capacity is reserved up front for
+* the worst case (every vertex is unique), so the table never rehashes and the
+* load factor stays below 0.5.
+*/
+class VertexWelder
+{
+public:
+    VertexWelder(size_t maxVertices, float epsilon) : epsilon(epsilon)
+    {
+        size_t capacity = 16;
+        while (capacity < 2 * maxVertices) capacity <<= 1;
+        slots.assign(capacity, EMPTY_SLOT);
+        mask = capacity - 1;
+        entries.reserve(maxVertices);
+    }
+
+    /* Returns true and the existing index if the vertex was already welded,
+    * otherwise remembers it under newIndex and returns false.
+    */
+    bool findOrInsert(const PackedVertex& packed, unsigned int newIndex,
+        unsigned int& result)
+    {
+        WeldKey key = makeWeldKey(packed, epsilon);
+        size_t slot = hashWeldKey(key) & mask;
+        while (slots[slot] != EMPTY_SLOT)
+        {
+            const Entry& entry = entries[slots[slot]];
+            if (entry.key == key)
+            {
+                result = entry.index;
+                return true;
+            }
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = (unsigned int)entries.size();
+        Entry entry = { key, newIndex };
+        entries.push_back(entry);
+        return false;
+    }
+
+private:
+    struct Entry
+    {
+        WeldKey key;
+        unsigned int index;
+    };
+
+    float epsilon;
+    size_t mask;
+    vector<unsigned int> slots;  // position in entries or EMPTY_SLOT
+    vector<Entry> entries;
+};
+
 void indexVBO(
     const vector<vec3>& in_vertices,
     const vector<vec2>& in_uvs,
@@ -320,9 +423,11 @@ void indexVBO(
     vector<unsigned int>& out_indices,
     vector<vec3>& out_vertices,
     vector<vec2>& out_uvs,
-    vector<vec3>& out_normals)
+    vector<vec3>& out_normals,
+    float epsilon)
 {
-    map<PackedVertex, unsigned int> vertexToOutIndex;
+    VertexWelder welder(in_vertices.size(), epsilon);
+    out_indices.reserve(out_indices.size() + in_vertices.size());
 
     // For each input vertex
     for (int i = 0; i < in_vertices.size(); i++)
@@ -336,7 +441,8 @@ void indexVBO(
 
         // Try to find a similar vertex in out_XXXX
         unsigned int index;
-        bool found = getSimilarVertexIndex(packed, vertexToOutIndex, index);
+        bool found = welder.findOrInsert(packed,
+            (unsigned int)out_vertices.size(), index);
 
         if (found)
         { // A similar vertex is already in the VBO, use it instead !
@@ -349,7 +455,6 @@ void indexVBO(
             if (in_normals.size() != 0) out_normals.push_back(normals);
             unsigned int newindex = (unsigned int)out_vertices.size() - 1;
             out_indices.push_back(newindex);
-            vertexToOutIndex[packed] = newindex;
         }
     }
 }
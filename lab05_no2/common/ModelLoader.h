@@ -47,7 +47,9 @@ void loadOBJWithTiny(
 );
 
 /**
-* Create VBO indexing.
+* Create VBO indexing. Identical vertices are welded with a hash table. If
+* epsilon > 0 the position, uv and normal are quantized to a grid of that size
+* before comparison, so nearly identical vertices are welded as well.
 * http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-9-vbo-indexing/
 */
 void indexVBO(
@@ -57,7 +59,8 @@ void indexVBO(
     std::vector<unsigned int> & out_indices,
     std::vector<glm::vec3> & out_vertices,
     std::vector<glm::vec2> & out_uvs,
-    std::vector<glm::vec3> & out_normals
+    std::vector<glm::vec3> & out_normals,
+    float epsilon = 0.0f
 );
 
 class Drawable
@@ -0,0 +1,200 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+Profiler::Profiler(const string& tracePath, int window, int traceFrames) :
+    tracePath(tracePath), window(window), traceFrames(traceFrames), frame(0),
+    origin(Clock::now()), frameStart(0), gpuZoneOpen(false) {
+    issued[0] = issued[1] = 0;
+}
+
+Profiler::~Profiler() {
+    // the queries belong to the context, which may be gone already; finish()
+    // reads and deletes them while it is current
+    if (tracePath.empty()) return;
+    try {
+        writeTrace(tracePath);
+    } catch (exception& ex) {
+        cout << ex.what() << endl;
+    }
+}
+
+double Profiler::now() const {
+    return chrono::duration<double, micro>(Clock::now() - origin).count();
+}
+
+int Profiler::zoneIndex(const char* name) {
+    // by content, so names built at run time can't be confused or dangle
+    map<string, int>::iterator named = namedZones.find(name);
+    if (named != namedZones.end()) return named->second;
+
+    Zone zone = {name, 0, 0, 0, 0};
+    zones.push_back(zone);
+    int index = (int) zones.size() - 1;
+    namedZones[name] = index;
+    return index;
+}
+
+void Profiler::readQueries(vector<Query>& queries, int count) {
+    for (int i = 0; i < count; i++) {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[i].id, GL_QUERY_RESULT, &elapsed);
+        double duration = elapsed / 1000.0;
+        zones[queries[i].zone].gpu += duration / 1000.0;
+        if (queries[i].traced) {
+            TraceEvent event = {queries[i].zone, true, queries[i].start, duration};
+            trace.push_back(event);
+        }
+    }
+}
+
+void Profiler::beginFrame() {
+    // the queries of two frames ago finished while the last frame was built
+    int buffer = frame % 2;
+    readQueries(queries[buffer], issued[buffer]);
+    issued[buffer] = 0;
+    frameStart = now();
+}
+
+bool Profiler::endFrame() {
+    if (!openZones.empty()) {
+        throw runtime_error("Profiler::endFrame(): a zone was not ended");
+    }
+
+    double end = now();
+    if (frame < traceFrames) {
+        TraceEvent event = {-1, false, frameStart, end - frameStart};
+        trace.push_back(event);
+    }
+    if ((int) frameTimes.size() < window) {
+        frameTimes.push_back((end - frameStart) / 1000.0);
+    } else {
+        frameTimes[frame % window] = (end - frameStart) / 1000.0;
+    }
+    frame++;
+
+    if (frame % window != 0) return false;
+    // the GPU times lag two frames behind, which does not matter on average
+    for (int i = 0; i < (int) zones.size(); i++) {
+        zones[i].averageCpu = zones[i].cpu / window;
+        zones[i].averageGpu = zones[i].gpu / window;
+        zones[i].cpu = zones[i].gpu = 0;
+    }
+    return true;
+}
+
+void Profiler::beginZone(const char* name, bool gpu) {
+    OpenZone zone = {zoneIndex(name), -1, 0};
+    if (gpu && !gpuZoneOpen) {
+        int buffer = frame % 2;
+        if (issued[buffer] == (int) queries[buffer].size()) {
+            Query query = {0, 0, 0, false};
+            glGenQueries(1, &query.id);
+            queries[buffer].push_back(query);
+        }
+        zone.query = issued[buffer]++;
+        glBeginQuery(GL_TIME_ELAPSED, queries[buffer][zone.query].id);
+        gpuZoneOpen = true;
+    }
+    zone.start = now();
+    openZones.push_back(zone);
+}
+
+void Profiler::endZone() {
+    if (openZones.empty()) {
+        throw runtime_error("Profiler::endZone(): no zone was begun");
+    }
+
+    OpenZone zone = openZones.back();
+    openZones.pop_back();
+    double end = now();
+    zones[zone.zone].cpu += (end - zone.start) / 1000.0;
+    if (frame < traceFrames) {
+        TraceEvent event = {zone.zone, false, zone.start, end - zone.start};
+        trace.push_back(event);
+    }
+
+    if (zone.query >= 0) {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuZoneOpen = false;
+        Query& query = queries[frame % 2][zone.query];
+        query.zone = zone.zone;
+        query.start = zone.start;
+        query.traced = frame < traceFrames;
+    }
+}
+
+void Profiler::finish() {
+    // the buffer of two frames ago first, then the one of the last frame
+    for (int i = 0; i < 2; i++) {
+        int buffer = (frame + i) % 2;
+        readQueries(queries[buffer], issued[buffer]);
+        issued[buffer] = 0;
+        for (size_t k = 0; k < queries[buffer].size(); k++) {
+            glDeleteQueries(1, &queries[buffer][k].id);
+        }
+        queries[buffer].clear();
+    }
+}
+
+double Profiler::frameTime(double percentile) const {
+    if (frameTimes.empty()) return 0;
+
+    // nearest rank
+    vector<double> sorted(frameTimes);
+    int rank = (int) ceil(percentile / 100.0 * sorted.size()) - 1;
+    rank = std::max(0, std::min(rank, (int) sorted.size() - 1));
+    nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+string Profiler::summary() const {
+    ostringstream out;
+    out << fixed << setprecision(2)
+        << "p50 " << frameTime(50) << " p95 " << frameTime(95)
+        << " p99 " << frameTime(99) << " ms";
+    for (int i = 0; i < (int) zones.size(); i++) {
+        out << " | " << zones[i].name << " " << zones[i].averageCpu;
+        if (zones[i].averageGpu > 0) out << "/" << zones[i].averageGpu;
+    }
+    return out.str();
+}
+
+static string escape(const string& name) {
+    string escaped;
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] == '"' || name[i] == '\\') escaped += '\\';
+        escaped += name[i];
+    }
+    return escaped;
+}
+
+void Profiler::writeTrace(const string& path) const {
+    ofstream out(path.c_str());
+    if (!out.is_open()) {
+        throw runtime_error("Can't write the trace: " + path);
+    }
+
+    // complete ("X") events, the CPU zones on thread 0 and the GPU ones on 1
+    out << "{\"traceEvents\":[" << endl
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,"
+        << "\"args\":{\"name\":\"CPU\"}}," << endl
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,"
+        << "\"args\":{\"name\":\"GPU\"}}";
+    out << fixed << setprecision(3);
+    for (size_t i = 0; i < trace.size(); i++) {
+        const TraceEvent& event = trace[i];
+        string name = event.zone < 0 ? "frame" : escape(zones[event.zone].name);
+        out << "," << endl << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,"
+            << "\"tid\":" << (event.gpu ? 1 : 0) << ",\"ts\":" << event.start
+            << ",\"dur\":" << event.duration << "}";
+    }
+    out << endl << "]}" << endl;
+}
@@ -17,6 +17,7 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/profiler.h>
 #include <common/camera.h>
 #include <common/ModelLoader.h>
 #include <common/texture.h>
@@ -36,6 +37,7 @@ void free();
 
 // Global variables
 GLFWwindow* window;
+Profiler profiler;
 Camera* camera;
 GLuint shaderProgram;
 GLuint projectionMatrixLocation, viewMatrixLocation, modelMatrixLocation;
@@ -159,6 +161,7 @@ void free()
 
     glDeleteTextures(1, &diffuseTexture);
     glDeleteProgram(shaderProgram);
+    profiler.finish();
     glfwTerminate();
 }
 
@@ -168,6 +171,8 @@ void mainLoop()
 
     do
     {
+        profiler.beginFrame();
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(shaderProgram);
@@ -212,6 +217,11 @@ void mainLoop()
         glfwSwapBuffers(window);
 
         glfwPollEvents();
+
+        // frame time percentiles in the title
+        if (profiler.endFrame()) {
+            glfwSetWindowTitle(window, (string(TITLE) + " | " + profiler.summary()).c_str());
+        }
     } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
 }
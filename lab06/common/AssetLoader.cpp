@@ -0,0 +1,52 @@
+#include "AssetLoader.h"
+#include "ModelLoader.h"
+
+using namespace std;
+
+AssetLoader::AssetLoader(unsigned int threads) : pool(threads) {
+}
+
+AssetLoader::~AssetLoader() {
+    for (Request& request : requests) {
+        if (request.done.valid()) request.done.wait();
+        delete request.data;
+    }
+}
+
+void AssetLoader::queue(const string& path, Request& request) {
+    MeshData* data = new MeshData();
+    request.data = data;
+    request.done = pool.submit([path, data]() { loadMeshData(path, *data); });
+    requests.push_back(std::move(request));
+}
+
+void AssetLoader::load(const string& path, vector<Drawable*>& drawables) {
+    Request request;
+    request.drawables = &drawables;
+    request.drawable = NULL;
+    queue(path, request);
+}
+
+void AssetLoader::load(const string& path, Drawable*& drawable) {
+    Request request;
+    request.drawables = NULL;
+    request.drawable = &drawable;
+    queue(path, request);
+}
+
+void AssetLoader::finish() {
+    // wait for all of them first, so a failure doesn't leave workers running
+    for (Request& request : requests) {
+        request.done.wait();
+    }
+
+    for (Request& request : requests) {
+        request.done.get();  // rethrows the worker's exception
+        Drawable* drawable = new Drawable(*request.data);
+        delete request.data;
+        request.data = NULL;
+        if (request.drawables != NULL) request.drawables->push_back(drawable);
+        if (request.drawable != NULL) *request.drawable = drawable;
+    }
+    requests.clear();
+}
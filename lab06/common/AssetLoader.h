@@ -0,0 +1,56 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <vector>
+#include <string>
+#include <future>
+#include "ThreadPool.h"
+
+class Drawable;
+struct MeshData;
+
+/**
+* Loads many mesh files in parallel. The CPU side (parsing, triangulation,
+* indexVBO, mesh cache I/O) runs on a thread pool, while the Drawables, and
+* thus the GL uploads, are created on the calling thread in finish().
+*
+*   AssetLoader loader;
+*   loader.load("models/femur.vtp", femurR->drawables);
+*   ...
+*   loader.finish(); // femurR->drawables is filled here
+*/
+class AssetLoader {
+public:
+    AssetLoader(unsigned int threads = std::thread::hardware_concurrency());
+
+    /* Destroys the meshes that were never finished */
+    ~AssetLoader();
+
+    /* Queue a file, its Drawable is appended to drawables by finish() */
+    void load(const std::string& path, std::vector<Drawable*>& drawables);
+
+    /* Queue a file, drawable is assigned by finish() */
+    void load(const std::string& path, Drawable*& drawable);
+
+    /* Wait for the queued files and create their Drawables in request order.
+    * Rethrows the first decoding error.
+    */
+    void finish();
+
+    size_t threads() const { return pool.size(); }
+
+private:
+    struct Request {
+        std::vector<Drawable*>* drawables;
+        Drawable** drawable;
+        MeshData* data;
+        std::future<void> done;
+    };
+
+    void queue(const std::string& path, Request& request);
+
+    ThreadPool pool;
+    std::vector<Request> requests;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "GeometryPool.h"
+#include "ModelLoader.h"
+#include "skinning.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+using namespace glm;
+using namespace std;
+
+bool GeometryPool::useIndirect = true;
+
+GeometryPool::GeometryPool(GLuint shaderProgram) {
+    // a palette is just a texture buffer of matrices
+    buffer = new BonePalette(64);
+
+    useGeometryPoolLocation = glGetUniformLocation(shaderProgram, "useGeometryPool");
+    meshTransformationsLocation = glGetUniformLocation(shaderProgram,
+        "meshTransformations");
+
+    // the mesh transformations are read from unit 5, set once so that the
+    // samplerBuffer never shares unit 0 with the sampler2Ds
+    glUseProgram(shaderProgram);
+    glUniform1i(meshTransformationsLocation, 5);
+}
+
+GeometryPool::~GeometryPool() {
+    glDeleteBuffers(1, &verticesVBO);
+    glDeleteBuffers(1, &elementVBO);
+    glDeleteBuffers(1, &indirectBuffer);
+    glDeleteVertexArrays(1, &VAO);
+    delete buffer;
+}
+
+int GeometryPool::add(const Drawable& drawable) {
+    if (VAO != 0) {
+        throw logic_error("GeometryPool::add(): the pool is already built");
+    }
+
+    const vector<vec3>& vertices = drawable.indexedVertices;
+    const vector<vec3>& normals = drawable.indexedNormals;
+    const vector<vec2>& uvs = drawable.indexedUVS;
+    GLuint mesh = (GLuint) commands.size();
+
+    DrawCommand command;
+    command.count = (GLuint) drawable.indices.size();
+    command.instanceCount = 1;
+    command.firstIndex = (GLuint) indexData.size();
+    command.baseVertex = (GLint) vertexData.size();
+    command.baseInstance = 0;
+    commands.push_back(command);
+    boxes.push_back(drawable.boundingBox);
+    largestMesh = std::max(largestMesh, (GLuint) vertices.size());
+
+    // the indices stay relative to the mesh, baseVertex offsets them
+    indexData.insert(indexData.end(), drawable.indices.begin(), drawable.indices.end());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        Vertex vertex;
+        vertex.position = vertices[i];
+        vertex.normal = normals.empty() ? vec3(0) : normals[i];
+        vertex.uv = uvs.empty() ? vec2(0) : uvs[i];
+        vertex.mesh = mesh;
+        vertexData.push_back(vertex);
+    }
+    return (int) mesh;
+}
+
+void GeometryPool::build() {
+    GLsizei stride = sizeof(Vertex);
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    glGenBuffers(1, &verticesVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(Vertex),
+        vertexData.empty() ? NULL : &vertexData[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, NULL);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(Vertex, uv));
+    glEnableVertexAttribArray(2);
+    // the mesh id, an integer attribute at location 6
+    glVertexAttribIPointer(6, 1, GL_UNSIGNED_INT, stride, (void*) offsetof(Vertex, mesh));
+    glEnableVertexAttribArray(6);
+
+    // the indices are relative to their mesh, so 16 bits are enough as long
+    // as every mesh is small enough
+    indexType = largestMesh <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    glGenBuffers(1, &elementVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
+    if (indexType == GL_UNSIGNED_SHORT) {
+        vector<uint16_t> shortIndices(indexData.begin(), indexData.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t),
+            shortIndices.empty() ? NULL : &shortIndices[0], GL_STATIC_DRAW);
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(uint32_t),
+            indexData.empty() ? NULL : &indexData[0], GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+
+    indirect = useIndirect && (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect);
+    if (indirect) {
+        glGenBuffers(1, &indirectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand),
+            NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // the GPU has them now
+    vector<Vertex>().swap(vertexData);
+    vector<unsigned int>().swap(indexData);
+    transformations.assign(commands.size(), mat4(1.0f));
+}
+
+void GeometryPool::begin() {
+    // keeps the capacity, so a steady scene does not allocate
+    queued.clear();
+}
+
+void GeometryPool::queue(int mesh, const mat4& modelMatrix) {
+    if (mesh < 0 || mesh >= meshes()) {
+        throw out_of_range("GeometryPool::queue(): no such mesh");
+    }
+    transformations[mesh] = modelMatrix;
+    queued.push_back(commands[mesh]);
+}
+
+void GeometryPool::draw(int mode) {
+    if (VAO == 0) {
+        throw logic_error("GeometryPool::draw(): build() was not called");
+    }
+    if (queued.empty()) return;
+
+    buffer->upload(&transformations[0], meshes());
+    buffer->bind(5);
+    glUniform1i(useGeometryPoolLocation, 1);
+    glBindVertexArray(VAO);
+
+    if (indirect) {
+        // orphan the commands of the previous frame
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand),
+            NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, queued.size() * sizeof(DrawCommand),
+            &queued[0]);
+        glMultiDrawElementsIndirect(mode, indexType, NULL, (GLsizei) queued.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+        for (const DrawCommand& command : queued) {
+            counts.push_back(command.count);
+            offsets.push_back((const void*) (command.firstIndex * indexSize));
+            baseVertices.push_back(command.baseVertex);
+        }
+        glMultiDrawElementsBaseVertex(mode, &counts[0], indexType, &offsets[0],
+            (GLsizei) queued.size(), &baseVertices[0]);
+    }
+
+    glUniform1i(useGeometryPoolLocation, 0);
+}
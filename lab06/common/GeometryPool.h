@@ -0,0 +1,96 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "culling.h"
+
+class Drawable;
+class BonePalette;
+
+/**
+* The meshes of many Drawables packed into one VAO: a shared interleaved
+* vertex buffer (position, normal, uv and mesh id, 36 bytes) and a shared
+* index buffer. Each mesh keeps its first index and base vertex, so any
+* subset of them is drawn with a single glMultiDrawElementsIndirect (GL 4.3
+* or ARB_multi_draw_indirect), or glMultiDrawElementsBaseVertex on GL 3.3.
+* The vertex shader reads the model matrix of a vertex from a texture
+* buffer at its mesh id, so every mesh keeps its own transformation.
+*
+* add() the meshes, build(), then each frame begin(), queue() the visible
+* meshes with their model matrices and draw().
+*
+* The pool holds a copy: the buffers of the added Drawables are left alone,
+* as their owner may still draw them one by one (the crowd instances them and
+* the per-drawable path is a runtime toggle). An owner that only draws
+* through the pool can free them after build().
+*/
+class GeometryPool {
+public:
+    GeometryPool(GLuint shaderProgram);
+    ~GeometryPool();
+
+    /* Append the mesh of drawable and return its id, call before build() */
+    int add(const Drawable& drawable);
+
+    /* Upload the vertices and indices of every added mesh */
+    void build();
+
+    int meshes() const { return (int) commands.size(); }
+
+    /* Bounds of a mesh in its model space, for frustum culling */
+    const BoundingBox& boundingBox(int mesh) const { return boxes.at(mesh); }
+
+    void begin();
+
+    /* Draw mesh with modelMatrix at the next draw() */
+    void queue(int mesh, const glm::mat4& modelMatrix);
+
+    /* Draw every queued mesh with one call */
+    void draw(int mode = GL_TRIANGLES);
+
+    /* Set to false to use glMultiDrawElementsBaseVertex even on GL 4.3 */
+    static bool useIndirect;
+
+private:
+    GeometryPool(const GeometryPool&);
+    GeometryPool& operator=(const GeometryPool&);
+
+    // the layout of GL_DRAW_INDIRECT_BUFFER commands
+    struct DrawCommand {
+        GLuint count, instanceCount, firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct Vertex {
+        glm::vec3 position, normal;
+        glm::vec2 uv;
+        GLuint mesh;
+    };
+
+    // CPU copy of the meshes until build()
+    std::vector<Vertex> vertexData;
+    std::vector<unsigned int> indexData;
+    std::vector<DrawCommand> commands;  // one per mesh
+    std::vector<BoundingBox> boxes;
+    GLuint largestMesh = 0;  // in vertices
+
+    // the transformation of every mesh (queued or not) and the queued commands
+    std::vector<glm::mat4> transformations;
+    std::vector<DrawCommand> queued;
+    // the same for glMultiDrawElementsBaseVertex
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+
+    GLuint VAO = 0, verticesVBO = 0, elementVBO = 0, indirectBuffer = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    bool indirect = false;
+    BonePalette* buffer;
+
+    GLuint useGeometryPoolLocation, meshTransformationsLocation;
+};
+
+#endif
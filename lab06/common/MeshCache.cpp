@@ -0,0 +1,276 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <sys/stat.h>
+#include "MeshCache.h"
+
+using namespace glm;
+using namespace std;
+
+static const uint32_t MESH_CACHE_MAGIC = 0x4853454d;  // "MESH"
+static const uint32_t MESH_CACHE_VERSION = 2;
+
+MeshLoadStats meshLoadStats;
+bool MeshCache::compressIndices = false;
+
+string meshCachePath(const string& sourcePath) {
+    return sourcePath + ".meshcache";
+}
+
+static bool statSource(const string& path, uint64_t& size, uint64_t& time) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = (uint64_t) st.st_size;
+    // nanoseconds where available, so edits within a second are noticed
+#if defined(__linux__)
+    time = (uint64_t) st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    time = (uint64_t) st.st_mtimespec.tv_sec * 1000000000ull + st.st_mtimespec.tv_nsec;
+#else
+    time = (uint64_t) st.st_mtime * 1000000000ull;
+#endif
+    return true;
+}
+
+/*
+* Indices of a welded mesh mostly refer to recent vertices, so the delta to the
+* previous index is small. It is zigzag encoded (0, -1, 1, -2, ... become
+* 0, 1, 2, 3, ...) and written 7 bits per byte, the high bit marking that more
+* bytes follow.
+*/
+static void compressIndexData(const vector<unsigned int>& indices, vector<char>& out) {
+    uint32_t previous = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        int32_t delta = (int32_t) (indices[i] - previous);
+        uint32_t value = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+        while (value >= 0x80) {
+            out.push_back((char) (value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char) value);
+        previous = indices[i];
+    }
+}
+
+static void decompressIndexData(const char* data, size_t size, uint32_t vertexCount,
+    vector<unsigned int>& indices) {
+    const unsigned char* p = (const unsigned char*) data;
+    const unsigned char* end = p + size;
+    uint32_t previous = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint32_t value = 0;
+        int shift = 0;
+        do {
+            if (p == end || shift > 28) {
+                throw runtime_error("Corrupt indices in mesh cache");
+            }
+            value |= (uint32_t) (*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        previous += (value >> 1) ^ (0u - (value & 1));
+        if (previous >= vertexCount) {
+            throw runtime_error("Corrupt indices in mesh cache");
+        }
+        indices[i] = previous;
+    }
+}
+
+/* Bytes per interleaved vertex: position, then the attributes present */
+static uint32_t vertexStride(uint32_t attributes) {
+    return sizeof(vec3) + (attributes & MESH_CACHE_NORMALS ? sizeof(vec3) : 0) +
+        (attributes & MESH_CACHE_UVS ? sizeof(vec2) : 0);
+}
+
+/* FNV-1a over the whole source file */
+static uint64_t hashSource(const string& path) {
+    MappedFile file(path);
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char* p = (const unsigned char*) file.data();
+    for (size_t i = 0; i < file.size(); i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/* Store the new modification time of an unchanged source in its cache */
+static void refreshSourceTime(const string& cachePath, uint64_t sourceTime) {
+    FILE* file = fopen(cachePath.c_str(), "r+b");
+    if (file == NULL) return;
+    if (fseek(file, (long) offsetof(MeshCacheHeader, sourceTime), SEEK_SET) != 0 ||
+        fwrite(&sourceTime, sizeof(sourceTime), 1, file) != 1) {
+        cout << "Can't update mesh cache: " << cachePath << endl;
+    }
+    fclose(file);
+}
+
+MeshCache* MeshCache::open(const string& sourcePath) {
+    string cachePath = meshCachePath(sourcePath);
+    uint64_t sourceSize, sourceTime;
+    if (!fileExists(cachePath) || !statSource(sourcePath, sourceSize, sourceTime)) {
+        return NULL;
+    }
+
+    MeshCache* cache = new MeshCache(cachePath);
+    bool valid = cache->file.size() >= sizeof(MeshCacheHeader);
+    bool touched = false;
+    if (valid) {
+        const MeshCacheHeader& h = cache->header();
+        valid = h.magic == MESH_CACHE_MAGIC && h.version == MESH_CACHE_VERSION &&
+            (h.indexSize == 2 || h.indexSize == 4) &&
+            h.stride == vertexStride(h.attributes) &&
+            cache->file.size() == sizeof(MeshCacheHeader) +
+            (size_t) h.vertexCount * h.stride + h.indexBytes &&
+            ((h.attributes & MESH_CACHE_COMPRESSED_INDICES) != 0 ||
+            h.indexBytes == (uint64_t) h.indexCount * h.indexSize) &&
+            h.sourceSize == sourceSize &&
+            (h.sourceTime == sourceTime || h.sourceHash == hashSource(sourcePath));
+        touched = valid && h.sourceTime != sourceTime;
+    }
+    if (!valid) {
+        delete cache;
+        return NULL;
+    }
+    if (touched) {
+        // the source was only touched, so later launches can skip the hash;
+        // the file is written unmapped, as Windows maps it without sharing
+        delete cache;
+        refreshSourceTime(cachePath, sourceTime);
+        cache = new MeshCache(cachePath);
+    }
+    return cache;
+}
+
+void MeshCache::write(
+    const string& sourcePath,
+    const vector<vec3>& vertices,
+    const vector<vec2>& uvs,
+    const vector<vec3>& normals,
+    const vector<unsigned int>& indices,
+    uint32_t flags) {
+    MeshCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = MESH_CACHE_MAGIC;
+    h.version = MESH_CACHE_VERSION;
+    if (!statSource(sourcePath, h.sourceSize, h.sourceTime)) return;
+    h.sourceHash = hashSource(sourcePath);
+    h.vertexCount = (uint32_t) vertices.size();
+    h.indexCount = (uint32_t) indices.size();
+    h.indexSize = vertices.size() <= 0x10000 ? 2 : 4;
+    h.attributes = (normals.size() != 0 ? MESH_CACHE_NORMALS : 0) |
+        (uvs.size() != 0 ? MESH_CACHE_UVS : 0) |
+        (flags & (MESH_CACHE_OPTIMIZED | MESH_CACHE_OVERDRAW_SORTED));
+    h.stride = vertexStride(h.attributes);
+
+    vector<char> compressed;
+    if (compressIndices) {
+        compressIndexData(indices, compressed);
+        h.attributes |= MESH_CACHE_COMPRESSED_INDICES;
+        h.indexBytes = (uint32_t) compressed.size();
+    } else {
+        h.indexBytes = h.indexCount * h.indexSize;
+    }
+
+    vector<char> data(sizeof(h) + (size_t) h.vertexCount * h.stride + h.indexBytes);
+    memcpy(&data[0], &h, sizeof(h));
+    char* p = &data[sizeof(h)];
+    for (size_t i = 0; i < vertices.size(); i++) {
+        memcpy(p, &vertices[i], sizeof(vec3));
+        p += sizeof(vec3);
+        if (normals.size() != 0) {
+            memcpy(p, &normals[i], sizeof(vec3));
+            p += sizeof(vec3);
+        }
+        if (uvs.size() != 0) {
+            memcpy(p, &uvs[i], sizeof(vec2));
+            p += sizeof(vec2);
+        }
+    }
+    if (compressIndices && !compressed.empty()) {
+        memcpy(p, &compressed[0], compressed.size());
+    }
+    for (size_t i = 0; i < indices.size() && !compressIndices; i++) {
+        if (h.indexSize == 2) {
+            uint16_t index = (uint16_t) indices[i];
+            memcpy(p, &index, 2);
+        } else {
+            memcpy(p, &indices[i], 4);
+        }
+        p += h.indexSize;
+    }
+
+    // write to a temporary file first, so a partial cache is never read;
+    // the name is unique per thread, as several may cache the same file
+    string cachePath = meshCachePath(sourcePath);
+    stringstream tempName;
+    tempName << cachePath << "." << this_thread::get_id() << "." << (void*) &h << ".tmp";
+    string tempPath = tempName.str();
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if (file == NULL) {
+        cout << "Can't write mesh cache: " << cachePath << endl;
+        return;
+    }
+    size_t written = fwrite(&data[0], 1, data.size(), file);
+    fclose(file);
+#ifdef _WIN32
+    // rename() replaces the destination atomically on POSIX only
+    remove(cachePath.c_str());
+#endif
+    if (written != data.size() || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        remove(tempPath.c_str());
+        cout << "Can't write mesh cache: " << cachePath << endl;
+    }
+}
+
+void MeshCache::unpack(
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals,
+    vector<unsigned int>& indices) const {
+    const MeshCacheHeader& h = header();
+    bool hasNormals = (h.attributes & MESH_CACHE_NORMALS) != 0;
+    bool hasUVs = (h.attributes & MESH_CACHE_UVS) != 0;
+    vertices.resize(h.vertexCount);
+    normals.resize(hasNormals ? h.vertexCount : 0);
+    uvs.resize(hasUVs ? h.vertexCount : 0);
+    indices.resize(h.indexCount);
+
+    const char* p = vertexData();
+    for (uint32_t i = 0; i < h.vertexCount; i++) {
+        memcpy(&vertices[i], p, sizeof(vec3));
+        p += sizeof(vec3);
+        if (hasNormals) {
+            memcpy(&normals[i], p, sizeof(vec3));
+            p += sizeof(vec3);
+        }
+        if (hasUVs) {
+            memcpy(&uvs[i], p, sizeof(vec2));
+            p += sizeof(vec2);
+        }
+    }
+
+    if (h.attributes & MESH_CACHE_COMPRESSED_INDICES) {
+        decompressIndexData(p, h.indexBytes, h.vertexCount, indices);
+    } else if (h.indexSize == 4) {
+        if (h.indexCount != 0) memcpy(&indices[0], p, (size_t) h.indexCount * 4);
+    } else {
+        for (uint32_t i = 0; i < h.indexCount; i++) {
+            uint16_t index;
+            memcpy(&index, p + 2 * i, 2);
+            indices[i] = index;
+        }
+    }
+
+    // decompressIndexData() checks its indices, the raw ones are checked here
+    // as they are also uploaded as they are
+    bool raw = (h.attributes & MESH_CACHE_COMPRESSED_INDICES) == 0;
+    for (uint32_t i = 0; i < h.indexCount && raw; i++) {
+        if (indices[i] >= h.vertexCount) {
+            throw runtime_error("Corrupt indices in mesh cache");
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include "util.h"
+
+enum MeshCacheAttributes {
+    MESH_CACHE_NORMALS = 1,
+    MESH_CACHE_UVS = 2,
+    // indices are stored as varints of the zigzag encoded delta to the previous one
+    MESH_CACHE_COMPRESSED_INDICES = 4,
+    // the mesh went through optimizeMesh(), with overdraw sorting
+    MESH_CACHE_OPTIMIZED = 8,
+    MESH_CACHE_OVERDRAW_SORTED = 16
+};
+
+/**
+* Header of a .meshcache file. It is followed by vertexCount interleaved
+* vertices (position, normal, uv; absent attributes are skipped) and then by
+* indexCount indices of indexSize bytes, or by indexBytes bytes of compressed
+* indices.
+*/
+struct MeshCacheHeader {
+    uint32_t magic, version;
+    // identity of the source file the cache was built from
+    uint64_t sourceSize, sourceTime, sourceHash;
+    uint32_t vertexCount, indexCount;
+    uint32_t indexSize;   // 2 or 4
+    uint32_t attributes;  // MeshCacheAttributes flags
+    uint32_t stride;      // bytes per interleaved vertex
+    uint32_t indexBytes;  // size of the index data
+};
+
+/**
+* Binary cache of an indexed mesh, stored next to its source as
+* <source>.meshcache. A cache is valid while the source keeps its size and
+* modification time; if only the time changed, the content hash decides and,
+* when it matches, the new time is stored so the next open() skips the hash.
+*/
+class MeshCache {
+public:
+    /* Map the cache of sourcePath, returns NULL if it is missing or stale */
+    static MeshCache* open(const std::string& sourcePath);
+
+    /*
+    * Create or replace the cache of sourcePath. flags are MESH_CACHE_OPTIMIZED
+    * and MESH_CACHE_OVERDRAW_SORTED. Errors are only logged.
+    */
+    static void write(
+        const std::string& sourcePath,
+        const std::vector<glm::vec3>& vertices,
+        const std::vector<glm::vec2>& uvs,
+        const std::vector<glm::vec3>& normals,
+        const std::vector<unsigned int>& indices,
+        uint32_t flags = 0);
+
+    const MeshCacheHeader& header() const { return *(const MeshCacheHeader*) file.data(); }
+    const char* vertexData() const { return file.data() + sizeof(MeshCacheHeader); }
+    const char* indexData() const {
+        return vertexData() + (size_t) header().vertexCount * header().stride;
+    }
+
+    /* Index data that can be uploaded as it is, NULL if it is compressed */
+    const char* rawIndexData() const {
+        return header().attributes & MESH_CACHE_COMPRESSED_INDICES ? NULL : indexData();
+    }
+
+    /* Copy the cached mesh back into separate arrays */
+    void unpack(
+        std::vector<glm::vec3>& vertices,
+        std::vector<glm::vec2>& uvs,
+        std::vector<glm::vec3>& normals,
+        std::vector<unsigned int>& indices) const;
+
+    /* Set to true to write compressed indices, mostly one byte per index */
+    static bool compressIndices;
+
+private:
+    MeshCache(const std::string& cachePath) : file(cachePath) {}
+
+    MappedFile file;
+};
+
+std::string meshCachePath(const std::string& sourcePath);
+
+/**
+* Counters of the meshes loaded by Drawable(path), e.g. to compare a cold
+* start (parsing the sources) with a warm one (reading the caches). seconds
+* is the loading time summed over all threads. Updated on the GL thread.
+*/
+struct MeshLoadStats {
+    int cacheHits = 0, cacheMisses = 0;
+    double seconds = 0;
+};
+
+extern MeshLoadStats meshLoadStats;
+
+#endif
@@ -0,0 +1,272 @@
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "MeshOptimizer.h"
+
+using namespace glm;
+using namespace std;
+
+static const unsigned int NO_VERTEX = 0xffffffff;
+
+VertexCacheStats analyzeVertexCache(
+    const vector<unsigned int>& indices,
+    size_t vertexCount,
+    unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indices.size() < 3 || vertexCount == 0) return stats;
+
+    // a vertex is in the FIFO while fewer than cacheSize misses happened after its own
+    vector<unsigned int> missTime(vertexCount, 0);
+    unsigned int misses = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int v = indices[i];
+        if (missTime[v] == 0 || misses + 1 - missTime[v] > cacheSize) {
+            misses++;
+            missTime[v] = misses;
+        }
+    }
+
+    stats.acmr = (float) misses / (indices.size() / 3);
+    stats.atvr = (float) misses / vertexCount;
+    return stats;
+}
+
+/*
+* Forsyth's scoring: vertices that were just used score high (the last
+* triangle's vertices get a fixed score so strips don't get too narrow), as
+* do vertices with few triangles left, so that no lonely triangles remain.
+*/
+static const int FORSYTH_CACHE_SIZE = 32;
+
+static float vertexScore(int cachePosition, unsigned int remainingTriangles) {
+    if (remainingTriangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = 0.75f;
+        } else {
+            float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+        }
+    }
+    return score + 2.0f / sqrt((float) remainingTriangles);
+}
+
+void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // triangles of each vertex, the first remaining[v] of them are not emitted yet
+    vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) remaining[indices[i]]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + remaining[v];
+    vector<unsigned int> adjacency(triangleCount * 3), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++) adjacency[fill[indices[i]]++] = i / 3;
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) vertexScores[v] = vertexScore(-1, remaining[v]);
+
+    vector<float> triangleScores(triangleCount);
+    vector<bool> emitted(triangleCount, false);
+    int best = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = vertexScores[indices[3 * t]] +
+            vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+        if (triangleScores[t] > triangleScores[best]) best = t;
+    }
+
+    // the cache holds the emitted triangle first, so it may grow by 3 before trimming
+    unsigned int cache[FORSYTH_CACHE_SIZE + 3], newCache[FORSYTH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+    size_t cursor = 0;
+    vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+
+    while (result.size() < triangleCount * 3) {
+        if (best < 0) {
+            // dead end, restart from the next triangle in the original order
+            while (emitted[cursor]) cursor++;
+            best = cursor;
+        }
+
+        emitted[best] = true;
+        int newCount = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[3 * best + k];
+            result.push_back(v);
+            newCache[newCount++] = v;
+
+            unsigned int* triangles = &adjacency[offsets[v]];
+            for (unsigned int j = 0; j < remaining[v]; j++) {
+                if (triangles[j] == (unsigned int) best) {
+                    triangles[j] = triangles[remaining[v] - 1];
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int v = cache[i];
+            if (v != newCache[0] && v != newCache[1] && v != newCache[2]) {
+                newCache[newCount++] = v;
+            }
+        }
+
+        // rescore the vertices that moved in or fell out of the cache
+        for (int i = 0; i < newCount; i++) {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? i : -1;
+            float score = vertexScore(cachePosition[v], remaining[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+            for (unsigned int j = 0; j < remaining[v]; j++) {
+                triangleScores[adjacency[offsets[v] + j]] += delta;
+            }
+        }
+        cacheCount = min(newCount, FORSYTH_CACHE_SIZE);
+        for (int i = 0; i < cacheCount; i++) cache[i] = newCache[i];
+
+        // the next triangle is the best one touching the cache
+        best = -1;
+        float bestScore = 0.0f;
+        for (int i = 0; i < cacheCount; i++) {
+            unsigned int v = cache[i];
+            for (unsigned int j = 0; j < remaining[v]; j++) {
+                unsigned int t = adjacency[offsets[v] + j];
+                if (best < 0 || triangleScores[t] > bestScore) {
+                    best = t;
+                    bestScore = triangleScores[t];
+                }
+            }
+        }
+    }
+
+    // keep the remainder of a list that is not made of whole triangles
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(result);
+}
+
+void optimizeOverdraw(vector<unsigned int>& indices, const vector<vec3>& vertices) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // a cluster starts at each triangle whose vertices all miss the cache
+    const unsigned int cacheSize = 16;
+    vector<unsigned int> missTime(vertices.size(), 0);
+    vector<size_t> clusters;
+    unsigned int misses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[3 * t + k];
+            if (missTime[v] == 0 || misses + 1 - missTime[v] > cacheSize) {
+                misses++;
+                missTime[v] = misses;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3) clusters.push_back(t);
+    }
+    if (clusters.size() < 2) return;
+    clusters.push_back(triangleCount);
+
+    // area weighted centroid and normal of every cluster and of the mesh
+    vector<vec3> centroids(clusters.size() - 1), normals(clusters.size() - 1);
+    vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c + 1 < clusters.size(); c++) {
+        vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const vec3& a = vertices[indices[3 * t]];
+            const vec3& b = vertices[indices[3 * t + 1]];
+            const vec3& d = vertices[indices[3 * t + 2]];
+            vec3 n = cross(b - a, d - a);
+            float triangleArea = length(n);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        centroids[c] = area > 0.0f ? centroid / area : vertices[indices[3 * clusters[c]]];
+        float normalLength = length(normal);
+        normals[c] = normalLength > 0.0f ? normal / normalLength : vec3(0.0f);
+        meshCentroid += centroid;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    // clusters facing outwards the most are drawn first
+    vector<float> keys(centroids.size());
+    vector<size_t> order(centroids.size());
+    for (size_t c = 0; c < centroids.size(); c++) {
+        keys[c] = dot(centroids[c] - meshCentroid, normals[c]);
+        order[c] = c;
+    }
+    stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+        return keys[a] > keys[b];
+    });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        result.insert(result.end(), indices.begin() + 3 * clusters[order[i]],
+            indices.begin() + 3 * clusters[order[i] + 1]);
+    }
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(result);
+}
+
+template <typename T>
+static void remapVertices(vector<T>& values, const vector<unsigned int>& remap,
+    unsigned int count) {
+    if (values.empty()) return;
+
+    vector<T> result(count);
+    for (size_t v = 0; v < values.size(); v++) {
+        if (remap[v] != NO_VERTEX) result[remap[v]] = values[v];
+    }
+    values.swap(result);
+}
+
+void optimizeVertexFetch(
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals,
+    vector<unsigned int>& indices) {
+    vector<unsigned int> remap(vertices.size(), NO_VERTEX);
+    unsigned int count = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        unsigned int& index = indices[i];
+        if (remap[index] == NO_VERTEX) remap[index] = count++;
+        index = remap[index];
+    }
+
+    remapVertices(vertices, remap, count);
+    remapVertices(uvs, remap, count);
+    remapVertices(normals, remap, count);
+}
+
+string optimizeMesh(
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals,
+    vector<unsigned int>& indices,
+    bool overdraw) {
+    VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+
+    optimizeVertexCache(indices, vertices.size());
+    if (overdraw) {
+        optimizeOverdraw(indices, vertices);
+    }
+    optimizeVertexFetch(vertices, uvs, normals, indices);
+
+    VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+    stringstream report;
+    report << fixed << setprecision(3)
+        << "ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr;
+    return report.str();
+}
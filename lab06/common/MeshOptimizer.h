@@ -0,0 +1,61 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+/**
+* Post-transform vertex cache efficiency of an indexed triangle list, measured
+* with a FIFO cache of cacheSize vertices. ACMR is the number of transformed
+* vertices per triangle (0.5 at best, 3 at worst) and ATVR the number of
+* transformed vertices per vertex (1 at best).
+*/
+struct VertexCacheStats {
+    float acmr = 0, atvr = 0;
+};
+
+VertexCacheStats analyzeVertexCache(
+    const std::vector<unsigned int>& indices,
+    size_t vertexCount,
+    unsigned int cacheSize = 16);
+
+/**
+* Reorders the triangles for the post-transform vertex cache with Tom
+* Forsyth's "Linear-Speed Vertex Cache Optimisation".
+*/
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+/**
+* Reorders clusters of triangles so that those facing away from the mesh
+* center, which are likely to occlude the rest, are drawn first. Clusters are
+* split where the vertex cache runs cold, so the ACMR is barely affected. Run
+* it after optimizeVertexCache().
+*/
+void optimizeOverdraw(
+    std::vector<unsigned int>& indices,
+    const std::vector<glm::vec3>& vertices);
+
+/**
+* Reorders the vertices in the order they are first used by the indices, so
+* vertex fetching walks memory linearly. Unused vertices are dropped. uvs and
+* normals may be empty.
+*/
+void optimizeVertexFetch(
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices);
+
+/**
+* Runs the passes above on an indexed mesh (see indexVBO()) and returns a
+* report of the vertex cache stats before and after.
+*/
+std::string optimizeMesh(
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices,
+    bool overdraw = false);
+
+#endif
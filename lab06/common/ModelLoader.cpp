@@ -1,15 +1,21 @@
 #include <iostream>
 #include <sstream>
-#include <map>
-#include <tinyxml2.h>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <stdint.h>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
+#include <glm/gtc/packing.hpp>
 #include "util.h"
+#include "vtp.h"
+#include "obj.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
 #include "ModelLoader.h"
 
 using namespace glm;
 using namespace std;
-using namespace tinyxml2;
 
 // simple OBJ loader
 void loadOBJ(
@@ -110,113 +116,70 @@ void loadVTP(
     vector<vec3>& normals,
     vector<unsigned int>& indices) {
     indices.clear();
-    const char* method = "PolygonalMesh::loadVtpFile()";
-    XMLDocument vtp;
-    assert(vtp.LoadFile(path.c_str()) == 0);
-
-    XMLElement* root = vtp.FirstChildElement("VTKFile");
-    assert(root != nullptr);
-    assert(root->Attribute("type", "PolyData"));
-
-    XMLElement* polydata = root->FirstChildElement("PolyData");
-    assert(polydata != nullptr);
-    XMLElement* piece = polydata->FirstChildElement("Piece");
-    assert(piece != nullptr);
-    XMLElement* enormals = piece->FirstChildElement("PointData");
-    assert(enormals != nullptr);
-    XMLElement* points = piece->FirstChildElement("Points");
-    assert(points != nullptr);
-
-    int numPoints, numPolys;
-    piece->QueryIntAttribute("NumberOfPoints", &numPoints);
-    piece->QueryIntAttribute("NumberOfPolys", &numPolys);
-
-    //assert(enormals->Attribute("format", "ascii"));
-    const char* normalsStr = enormals->FirstChildElement("DataArray")->FirstChild()->Value();
-    stringstream sNorm(normalsStr);
+
+    // the file is parsed in place, no DOM or intermediate strings are built
+    MappedFile file(path);
+    VTPPiece piece;
+    scanVTP(file.data(), file.size(), piece);
+    int numPoints = piece.numberOfPoints, numPolys = piece.numberOfPolys;
+
+    vector<vec3> coordinates(numPoints);
+    if (numPoints != 0) {
+        readVTPDataArray(piece, piece.points, &coordinates[0].x, 3 * numPoints);
+    }
+
     vector<vec3> tempNormals;
-    do {
-        vec3 normal;
-        sNorm >> normal.x >> normal.y >> normal.z;
-        tempNormals.push_back(normal);
-    } while (sNorm.good());
-    assert(tempNormals.size() == numPoints + 1);
-
-    XMLElement* pointData = points->FirstChildElement("DataArray");
-    assert(pointData != nullptr);
-    assert(pointData->Attribute("format", "ascii"));
-    const char* coordsStr = points->FirstChildElement("DataArray")->FirstChild()->Value();
-
-    stringstream sCoord(coordsStr);
-    vector<vec3> coordinates;
-    do {
-        vec3 coord;
-        sCoord >> coord.x >> coord.y >> coord.z;
-        coordinates.push_back(coord);
-    } while (sCoord.good());
-    coordinates.pop_back();  // the last is corrupted
-    assert(coordinates.size() == numPoints);
-
-    XMLElement* polys = piece->FirstChildElement("Polys");
-    assert(polys != nullptr);
-
-    // TODO beter implementation
-    XMLElement *econnectivity, *eoffsets;
-    if (polys->FirstChildElement("DataArray")->Attribute("Name", "connectivity")) {
-        econnectivity = polys->FirstChildElement("DataArray");
-        assert(econnectivity != nullptr);
-        assert(econnectivity->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access connectivity");
+    if (!piece.normals.empty() && numPoints != 0) {
+        tempNormals.resize(numPoints);
+        readVTPDataArray(piece, piece.normals, &tempNormals[0].x, 3 * numPoints);
     }
 
-    if (polys->LastChildElement("DataArray")->Attribute("Name", "offsets")) {
-        eoffsets = polys->LastChildElement("DataArray");
-        assert(eoffsets != nullptr);
-        assert(eoffsets->Attribute("format", "ascii"));
-    } else {
-        throw runtime_error("Can't access offsets");
+    vector<int> offsets(numPolys);
+    if (numPolys == 0) return;
+    readVTPDataArray(piece, piece.offsets, &offsets[0], numPolys);
+    vector<int> connectivity(offsets.back());
+    if (offsets.back() != 0) {
+        readVTPDataArray(piece, piece.connectivity, &connectivity[0], offsets.back());
     }
 
-    // read offsets
-    const char* offsetsStr = eoffsets->FirstChild()->Value();
-    stringstream sOffsets(offsetsStr);
-    vector<int> offsets;
-    do {
-        int offset;
-        sOffsets >> offset;
-        offsets.push_back(offset);
-    } while (sOffsets.good());
-    assert(offsets.size() == numPolys + 1);
-
-    // read connectivity
-    const char* connStr = econnectivity->FirstChild()->Value();
-    stringstream sConn(connStr);
-    vector<int> connectivity;
-    do {
-        int conn;
-        sConn >> conn;
-        connectivity.push_back(conn);
-    } while (sConn.good());
-    assert(connectivity.size() == offsets.back() + 1);
-
-    // construct vertices
+    // count the triangles of the fans to allocate the output once
+    size_t numTriangles = 0;
     int startPoly = 0;
     for (int i = 0; i < numPolys; ++i) {
-        vector<int> face = slice(connectivity, startPoly, offsets[i]);
-        int i1 = 0, i2 = 1, i3 = 2;
-        while (i3 != face.size()) {
-            vertices.push_back(coordinates[face[i1]]);
-            normals.push_back(tempNormals[face[i1]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i2]]);
-            normals.push_back(tempNormals[face[i2]]);
-            indices.push_back(indices.size());
-            vertices.push_back(coordinates[face[i3]]);
-            normals.push_back(tempNormals[face[i3]]);
-            indices.push_back(indices.size());
-            i2++;
-            i3++;
+        if (offsets[i] < startPoly || offsets[i] > offsets.back()) {
+            throw runtime_error("Invalid offsets in: " + path);
+        }
+        if (offsets[i] - startPoly >= 3) numTriangles += offsets[i] - startPoly - 2;
+        startPoly = offsets[i];
+    }
+    for (int c : connectivity) {
+        if (c < 0 || c >= numPoints) {
+            throw runtime_error("Invalid connectivity in: " + path);
+        }
+    }
+    if (numTriangles == 0) return;
+
+    size_t base = vertices.size();
+    vertices.resize(base + 3 * numTriangles);
+    if (!tempNormals.empty()) normals.resize(normals.size() + 3 * numTriangles);
+    indices.resize(3 * numTriangles);
+
+    // fan triangulation of every polygon
+    vec3* outVertex = &vertices[base];
+    vec3* outNormal = tempNormals.empty() ? NULL : &normals[normals.size() - 3 * numTriangles];
+    size_t n = 0;
+    startPoly = 0;
+    for (int i = 0; i < numPolys; ++i) {
+        const int* face = connectivity.data() + startPoly;
+        int faceSize = offsets[i] - startPoly;
+        for (int i3 = 2; i3 < faceSize; i3++) {
+            int corners[3] = {face[0], face[i3 - 1], face[i3]};
+            for (int k = 0; k < 3; k++) {
+                outVertex[n] = coordinates[corners[k]];
+                if (outNormal != NULL) outNormal[n] = tempNormals[corners[k]];
+                indices[n] = (unsigned int) n;
+                n++;
+            }
         }
         startPoly = offsets[i];
     }
@@ -238,6 +201,15 @@ void loadOBJWithTiny(
         throw runtime_error(err);
     }
 
+    size_t corners = 0;
+    for (const auto& shape : shapes) {
+        corners += shape.mesh.indices.size();
+    }
+    vertices.reserve(vertices.size() + corners);
+    if (attrib.texcoords.size() != 0) uvs.reserve(uvs.size() + corners);
+    if (attrib.normals.size() != 0) normals.reserve(normals.size() + corners);
+    indices.reserve(indices.size() + corners);
+
     for (const auto& shape : shapes) {
         for (const auto& index : shape.mesh.indices) {
             vec3 vertex = {
@@ -266,29 +238,129 @@ void loadOBJWithTiny(
     // TODO .mtl loader
 }
 
+void loadOBJIndexed(
+    const string& path,
+    vector<vec3>& vertices,
+    vector<vec2>& uvs,
+    vector<vec3>& normals,
+    vector<unsigned int>& indices) {
+    MappedFile file(path);
+    parseOBJ(file.data(), file.size(), vertices, uvs, normals, indices);
+}
+
 
 struct PackedVertex {
     glm::vec3 position;
     glm::vec2 uv;
     glm::vec3 normal;
-    bool operator<(const PackedVertex that) const {
-        return memcmp((void*) this, (void*) &that, sizeof(PackedVertex)) > 0;
-    };
 };
 
-bool getSimilarVertexIndex(
-    PackedVertex& packed,
-    map<PackedVertex, unsigned int>& vertexToOutIndex,
-    unsigned int& result) {
-    map<PackedVertex, unsigned int>::iterator it = vertexToOutIndex.find(packed);
-    if (it == vertexToOutIndex.end()) {
-        return false;
+/**
+* The key under which a PackedVertex is welded. In exact mode it holds the raw
+* bits of the 8 floats, so two vertices are welded only if they are bitwise
+* equal. In quantized mode every component is snapped to a grid of size
+* epsilon before comparison.
+*/
+struct WeldKey {
+    uint32_t v[8];
+
+    bool operator==(const WeldKey& that) const {
+        return memcmp(v, that.v, sizeof(v)) == 0;
+    }
+};
+
+/* Grid cell of f, clamped to the int32_t range (NaN goes to the lowest cell) */
+static uint32_t quantize(float f, float epsilon) {
+    double cell = floor((double) f / epsilon + 0.5);
+    if (!(cell >= INT32_MIN)) cell = INT32_MIN;
+    if (cell > INT32_MAX) cell = INT32_MAX;
+    return (uint32_t) (int32_t) cell;
+}
+
+static WeldKey makeWeldKey(const PackedVertex& packed, float epsilon) {
+    const float f[8] = {
+        packed.position.x, packed.position.y, packed.position.z,
+        packed.uv.x, packed.uv.y,
+        packed.normal.x, packed.normal.y, packed.normal.z};
+    WeldKey key;
+    if (epsilon > 0.0f) {
+        for (int i = 0; i < 8; i++) {
+            key.v[i] = quantize(f[i], epsilon);
+        }
     } else {
-        result = it->second;
-        return true;
+        memcpy(key.v, f, sizeof(f));
+    }
+    return key;
+}
+
+static uint32_t hashWeldKey(const WeldKey& key) {
+    // murmur3 style mixing of the 8 words
+    uint32_t h = 0x9e3779b9u;
+    for (int i = 0; i < 8; i++) {
+        uint32_t k = key.v[i] * 0xcc9e2d51u;
+        k = (k << 15) | (k >> 17);
+        h ^= k * 0x1b873593u;
+        h = ((h << 13) | (h >> 19)) * 5 + 0xe6546b64u;
     }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
 }
 
+static const unsigned int EMPTY_SLOT = 0xffffffffu;
+
+/**
+* Open addressing (linear probing) hash table that maps a vertex to its index
+* in the output arrays of indexVBO(). The capacity is reserved up front for
+* the worst case (every vertex is unique), so the table never rehashes and the
+* load factor stays below 0.5.
+*/
+class VertexWelder {
+public:
+    VertexWelder(size_t maxVertices, float epsilon) : epsilon(epsilon) {
+        size_t capacity = 16;
+        while (capacity < 2 * maxVertices) capacity <<= 1;
+        slots.assign(capacity, EMPTY_SLOT);
+        mask = capacity - 1;
+        entries.reserve(maxVertices);
+    }
+
+    /* Returns true and the existing index if the vertex was already welded,
+    * otherwise remembers it under newIndex and returns false.
+    */
+    bool findOrInsert(const PackedVertex& packed, unsigned int newIndex,
+        unsigned int& result) {
+        WeldKey key = makeWeldKey(packed, epsilon);
+        size_t slot = hashWeldKey(key) & mask;
+        while (slots[slot] != EMPTY_SLOT) {
+            const Entry& entry = entries[slots[slot]];
+            if (entry.key == key) {
+                result = entry.index;
+                return true;
+            }
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = (unsigned int) entries.size();
+        Entry entry = {key, newIndex};
+        entries.push_back(entry);
+        return false;
+    }
+
+private:
+    struct Entry {
+        WeldKey key;
+        unsigned int index;
+    };
+
+    float epsilon;
+    size_t mask;
+    vector<unsigned int> slots;  // position in entries or EMPTY_SLOT
+    vector<Entry> entries;
+};
+
 void indexVBO(
     const vector<vec3>& in_vertices,
     const vector<vec2>& in_uvs,
@@ -296,8 +368,10 @@ void indexVBO(
     vector<unsigned int>& out_indices,
     vector<vec3>& out_vertices,
     vector<vec2>& out_uvs,
-    vector<vec3>& out_normals) {
-    map<PackedVertex, unsigned int> vertexToOutIndex;
+    vector<vec3>& out_normals,
+    float epsilon) {
+    VertexWelder welder(in_vertices.size(), epsilon);
+    out_indices.reserve(out_indices.size() + in_vertices.size());
 
     // For each input vertex
     for (int i = 0; i < in_vertices.size(); i++) {
@@ -310,7 +384,8 @@ void indexVBO(
 
         // Try to find a similar vertex in out_XXXX
         unsigned int index;
-        bool found = getSimilarVertexIndex(packed, vertexToOutIndex, index);
+        unsigned int newindex = (unsigned int) out_vertices.size();
+        bool found = welder.findOrInsert(packed, newindex, index);
 
         if (found) { // A similar vertex is already in the VBO, use it instead !
             out_indices.push_back(index);
@@ -318,23 +393,88 @@ void indexVBO(
             out_vertices.push_back(vertices);
             if (in_uvs.size() != 0) out_uvs.push_back(uvs);
             if (in_normals.size() != 0) out_normals.push_back(normals);
-            unsigned int newindex = (unsigned int) out_vertices.size() - 1;
             out_indices.push_back(newindex);
-            vertexToOutIndex[packed] = newindex;
         }
     }
 }
 
-Drawable::Drawable(string path) {
-    if (path.substr(path.size() - 3, 3) == "obj") {
-        loadOBJWithTiny(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
-    } else if (path.substr(path.size() - 3, 3) == "vtp") {
-        loadVTP(path.c_str(), vertices, uvs, normals, VEC_UINT_DEFAUTL_VALUE);
-    } else {
-        throw runtime_error("File format not supported: " + path);
+MeshData::~MeshData() {
+    delete cache;
+}
+
+void loadMeshData(const string& path, MeshData& data) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    uint32_t optimization = 0;
+    if (Drawable::optimizeMeshes) {
+        optimization = MESH_CACHE_OPTIMIZED |
+            (Drawable::optimizeOverdraw ? MESH_CACHE_OVERDRAW_SORTED : 0);
     }
 
-    createContext();
+    data.cache = Drawable::useMeshCache ? MeshCache::open(path) : NULL;
+    if (data.cache != NULL && (data.cache->header().attributes &
+        (MESH_CACHE_OPTIMIZED | MESH_CACHE_OVERDRAW_SORTED)) != optimization) {
+        delete data.cache;
+        data.cache = NULL;
+    }
+    if (data.cache != NULL) {
+        try {
+            data.cache->unpack(data.indexedVertices, data.indexedUVS,
+                data.indexedNormals, data.indices);
+        } catch (const exception& e) {
+            // fall back to the source, which also rewrites the cache
+            cout << e.what() << ": " << path << endl;
+            delete data.cache;
+            data.cache = NULL;
+        }
+    }
+    if (data.cache == NULL) {
+        // loaders get their own indices, this may run on several threads
+        vector<unsigned int> sourceIndices;
+        if (path.substr(path.size() - 3, 3) == "obj") {
+            // welded while parsing, there is no unindexed copy
+            loadOBJIndexed(path, data.indexedVertices, data.indexedUVS,
+                data.indexedNormals, data.indices);
+        } else if (path.substr(path.size() - 3, 3) == "vtp") {
+            loadVTP(path.c_str(), data.vertices, data.uvs, data.normals,
+                sourceIndices);
+            indexVBO(data.vertices, data.uvs, data.normals, data.indices,
+                data.indexedVertices, data.indexedUVS, data.indexedNormals);
+        } else {
+            throw runtime_error("File format not supported: " + path);
+        }
+
+        if (Drawable::optimizeMeshes) {
+            // one write, as several threads may be reporting
+            string report = optimizeMesh(data.indexedVertices, data.indexedUVS,
+                data.indexedNormals, data.indices, Drawable::optimizeOverdraw);
+            cout << path + ": " + report + "\n" << flush;
+        }
+        if (Drawable::useMeshCache) {
+            MeshCache::write(path, data.indexedVertices, data.indexedUVS,
+                data.indexedNormals, data.indices, optimization);
+        }
+    }
+
+    calculateBounds(data.indexedVertices, data.boundingBox, data.boundingSphere);
+
+    data.seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+}
+
+bool Drawable::useMeshCache = true;
+VertexLayout Drawable::vertexLayout = INTERLEAVED;
+bool Drawable::optimizeMeshes = true;
+bool Drawable::optimizeOverdraw = false;
+
+Drawable::Drawable(string path) {
+    MeshData data;
+    loadMeshData(path, data);
+    createContext(data);
+}
+
+Drawable::Drawable(MeshData& data) {
+    createContext(data);
 }
 
 Drawable::Drawable(const vector<vec3>& vertices, const vector<vec2>& uvs,
@@ -355,44 +495,197 @@ void Drawable::bind() {
 }
 
 void Drawable::draw(int mode) {
-    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, NULL);
+    glDrawElements(mode, indices.size(), indexType, NULL);
+}
+
+void Drawable::drawInstanced(int instances, int mode) {
+    glDrawElementsInstanced(mode, indices.size(), indexType, NULL, instances);
 }
 
 void Drawable::createContext() {
     indices = vector<unsigned int>();
     indexVBO(vertices, uvs, normals, indices, indexedVertices, indexedUVS, indexedNormals);
+    calculateBounds(indexedVertices, boundingBox, boundingSphere);
+    upload();
+}
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+void Drawable::createContext(MeshData& data) {
+    vertices.swap(data.vertices);
+    uvs.swap(data.uvs);
+    normals.swap(data.normals);
+    indexedVertices.swap(data.indexedVertices);
+    indexedUVS.swap(data.indexedUVS);
+    indexedNormals.swap(data.indexedNormals);
+    indices.swap(data.indices);
+    boundingBox = data.boundingBox;
+    boundingSphere = data.boundingSphere;
+
+    // the cached vertices can only be uploaded as they are in the INTERLEAVED layout
+    if (data.cache != NULL && vertexLayout == INTERLEAVED) {
+        createContext(*data.cache);
+    } else {
+        upload();
+    }
+    if (data.cache != NULL) {
+        meshLoadStats.cacheHits++;
+    } else {
+        meshLoadStats.cacheMisses++;
+    }
+    meshLoadStats.seconds += data.seconds;
+}
 
-    glGenBuffers(1, &verticesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
-    glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
-        &indexedVertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+static size_t vertexStride(VertexLayout layout, bool hasNormals, bool hasUVs) {
+    size_t stride = sizeof(vec3);
+    if (layout == INTERLEAVED_PACKED) {
+        stride += (hasNormals ? sizeof(uint32_t) : 0) + (hasUVs ? sizeof(uint32_t) : 0);
+    } else {
+        stride += (hasNormals ? sizeof(vec3) : 0) + (hasUVs ? sizeof(vec2) : 0);
+    }
+    return stride;
+}
+
+/* Points attributes 0, 1 and 2 into the interleaved VBO bound to GL_ARRAY_BUFFER */
+static void interleavedAttributes(VertexLayout layout, bool hasNormals, bool hasUVs) {
+    GLsizei stride = vertexStride(layout, hasNormals, hasUVs);
+    bool packed = layout == INTERLEAVED_PACKED;
+    size_t offset = sizeof(vec3);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, NULL);
     glEnableVertexAttribArray(0);
 
-    if (indexedNormals.size() != 0) {
-        glGenBuffers(1, &normalsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
-            &indexedNormals[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    if (hasNormals) {
+        if (packed) {
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+                (void*) offset);
+            offset += sizeof(uint32_t);
+        } else {
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*) offset);
+            offset += sizeof(vec3);
+        }
         glEnableVertexAttribArray(1);
     }
 
-    if (indexedUVS.size() != 0) {
-        glGenBuffers(1, &uvsVBO);
-        glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
-        glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
-            &indexedUVS[0], GL_STATIC_DRAW);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    if (hasUVs) {
+        if (packed) {
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*) offset);
+        } else {
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*) offset);
+        }
         glEnableVertexAttribArray(2);
     }
+}
+
+void Drawable::upload() {
+    bool hasNormals = indexedNormals.size() != 0;
+    bool hasUVs = indexedUVS.size() != 0;
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    if (vertexLayout == SEPARATE_BUFFERS) {
+        glGenBuffers(1, &verticesVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
+        glBufferData(GL_ARRAY_BUFFER, indexedVertices.size() * sizeof(vec3),
+            &indexedVertices[0], GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+        glEnableVertexAttribArray(0);
+
+        if (hasNormals) {
+            glGenBuffers(1, &normalsVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, normalsVBO);
+            glBufferData(GL_ARRAY_BUFFER, indexedNormals.size() * sizeof(vec3),
+                &indexedNormals[0], GL_STATIC_DRAW);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+            glEnableVertexAttribArray(1);
+        }
+
+        if (hasUVs) {
+            glGenBuffers(1, &uvsVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, uvsVBO);
+            glBufferData(GL_ARRAY_BUFFER, indexedUVS.size() * sizeof(vec2),
+                &indexedUVS[0], GL_STATIC_DRAW);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+            glEnableVertexAttribArray(2);
+        }
+    } else {
+        bool packed = vertexLayout == INTERLEAVED_PACKED;
+        size_t stride = vertexStride(vertexLayout, hasNormals, hasUVs);
+        vector<char> buffer(indexedVertices.size() * stride);
+        char* out = buffer.empty() ? NULL : &buffer[0];
+        for (size_t i = 0; i < indexedVertices.size(); i++) {
+            memcpy(out, &indexedVertices[i], sizeof(vec3));
+            out += sizeof(vec3);
+            if (hasNormals) {
+                if (packed) {
+                    uint32_t normal = packSnorm3x10_1x2(vec4(indexedNormals[i], 0.0f));
+                    memcpy(out, &normal, sizeof(uint32_t));
+                    out += sizeof(uint32_t);
+                } else {
+                    memcpy(out, &indexedNormals[i], sizeof(vec3));
+                    out += sizeof(vec3);
+                }
+            }
+            if (hasUVs) {
+                if (packed) {
+                    uint32_t uv = packHalf2x16(indexedUVS[i]);
+                    memcpy(out, &uv, sizeof(uint32_t));
+                    out += sizeof(uint32_t);
+                } else {
+                    memcpy(out, &indexedUVS[i], sizeof(vec2));
+                    out += sizeof(vec2);
+                }
+            }
+        }
+
+        glGenBuffers(1, &verticesVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
+        glBufferData(GL_ARRAY_BUFFER, buffer.size(), buffer.empty() ? NULL : &buffer[0],
+            GL_STATIC_DRAW);
+        interleavedAttributes(vertexLayout, hasNormals, hasUVs);
+    }
 
     // Generate a buffer for the indices as well
+    uploadIndices(indexedVertices.size());
+}
+
+/*
+* Uploads the indices as 16 bit when every vertex can be addressed with them.
+* rawIndices of indexSize bytes, when given, are uploaded without conversion.
+*/
+void Drawable::uploadIndices(size_t vertexCount, const char* rawIndices, int indexSize) {
+    indexType = vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    size_t size = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
     glGenBuffers(1, &elementVBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-        &indices[0], GL_STATIC_DRAW);
-}
\ No newline at end of file
+    if (rawIndices != NULL && (size_t) indexSize == size) {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * size, rawIndices,
+            GL_STATIC_DRAW);
+    } else if (indexType == GL_UNSIGNED_SHORT) {
+        vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * size,
+            shortIndices.empty() ? NULL : &shortIndices[0], GL_STATIC_DRAW);
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * size,
+            indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+    }
+}
+
+void Drawable::createContext(const MeshCache& cache) {
+    const MeshCacheHeader& header = cache.header();
+    bool hasNormals = (header.attributes & MESH_CACHE_NORMALS) != 0;
+    bool hasUVs = (header.attributes & MESH_CACHE_UVS) != 0;
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    // the cache stores the INTERLEAVED layout, uploaded straight from the mapped file
+    glGenBuffers(1, &verticesVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, verticesVBO);
+    glBufferData(GL_ARRAY_BUFFER, (size_t) header.vertexCount * header.stride,
+        cache.vertexData(), GL_STATIC_DRAW);
+    interleavedAttributes(INTERLEAVED, hasNormals, hasUVs);
+
+    // uncompressed indices have the width uploadIndices() picks for vertexCount
+    uploadIndices(header.vertexCount, cache.rawIndexData(), header.indexSize);
+}
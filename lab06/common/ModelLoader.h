@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include <glm/glm.hpp>
+#include "culling.h"
 
 static std::vector<unsigned int> VEC_UINT_DEFAUTL_VALUE = std::vector<unsigned int>();
 static std::vector<glm::vec3> VEC_VEC3_DEFAUTL_VALUE = std::vector<glm::vec3>();
@@ -47,7 +48,23 @@ void loadOBJWithTiny(
 );
 
 /**
-* Create VBO indexing.
+* A fast .obj loader for large meshes. The file is mapped and parsed on
+* several threads by parseOBJ(), polygons, negative indices and missing
+* attributes included. Unlike the loaders above the output is indexed:
+* identical corners share a vertex, so no indexVBO() is needed.
+*/
+void loadOBJIndexed(
+    const std::string& path,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices
+);
+
+/**
+* Create VBO indexing. Identical vertices are welded with a hash table. If
+* epsilon > 0 the position, uv and normal are quantized to a grid of that size
+* before comparison, so nearly identical vertices are welded as well.
 * http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-9-vbo-indexing/
 */
 void indexVBO(
@@ -57,13 +74,62 @@ void indexVBO(
     std::vector<unsigned int> & out_indices,
     std::vector<glm::vec3> & out_vertices,
     std::vector<glm::vec2> & out_uvs,
-    std::vector<glm::vec3> & out_normals
+    std::vector<glm::vec3> & out_normals,
+    float epsilon = 0.0f
 );
 
+class MeshCache;
+
+/**
+* The CPU side of a Drawable loaded from a file: the indexed mesh, or the
+* mapped mesh cache it was read from. Unlike a Drawable it can be produced
+* on any thread (see AssetLoader).
+*/
+struct MeshData {
+    std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
+    std::vector<glm::vec2> uvs, indexedUVS;
+    std::vector<unsigned int> indices;
+    BoundingBox boundingBox;
+    BoundingSphere boundingSphere;
+    MeshCache* cache = NULL;  // owned, set when loaded from the cache
+    double seconds = 0;       // time spent loading
+
+    MeshData() {}
+    ~MeshData();
+
+private:
+    MeshData(const MeshData&);
+    MeshData& operator=(const MeshData&);
+};
+
+/**
+* Load a .obj or .vtp file and index it. Meshes are cached in
+* <path>.meshcache (see MeshCache) unless Drawable::useMeshCache is false.
+* Does not use OpenGL, so it is safe to call from worker threads.
+*/
+void loadMeshData(const std::string& path, MeshData& data);
+
+/**
+* How a Drawable stores its vertices on the GPU. All layouts feed the same
+* attribute locations (0 position, 1 normal, 2 uv), so shaders do not change.
+*/
+enum VertexLayout {
+    // one VBO per attribute
+    SEPARATE_BUFFERS,
+    // a single VBO of float position, normal and uv per vertex (32 bytes)
+    INTERLEAVED,
+    // a single VBO of float position, 2_10_10_10 normal and half float uv (20 bytes)
+    INTERLEAVED_PACKED
+};
+
 class Drawable {
 public:
+    /* Meshes loaded from files are cached in <path>.meshcache (see MeshCache) */
     Drawable(std::string path);
 
+    /* Upload a mesh produced by loadMeshData(), its arrays are moved */
+    Drawable(MeshData& data);
+
     Drawable(
         const std::vector<glm::vec3>& vertices,
         const std::vector<glm::vec2>& uvs = VEC_VEC2_DEFAUTL_VALUE,
@@ -73,18 +139,47 @@ public:
 
     void bind();
 
-    /* Bind VAO before calling draw */
+    /* Bind VAO before calling draw, the indices are drawn as indexType */
     void draw(int mode = GL_TRIANGLES);
 
+    /* Draw the mesh instances times, gl_InstanceID tells them apart */
+    void drawInstanced(int instances, int mode = GL_TRIANGLES);
+
 public:
+    // vertices, normals and uvs stay empty when the mesh comes from the cache
     std::vector<glm::vec3> vertices, normals, indexedVertices, indexedNormals;
     std::vector<glm::vec2> uvs, indexedUVS;
     std::vector<unsigned int> indices;
 
-    GLuint VAO, verticesVBO, uvsVBO, normalsVBO, elementVBO;
+    GLuint VAO = 0, verticesVBO = 0, uvsVBO = 0, normalsVBO = 0, elementVBO = 0;
+
+    // bounds of indexedVertices, for frustum culling (see Frustum)
+    BoundingBox boundingBox;
+    BoundingSphere boundingSphere;
+
+    // GL_UNSIGNED_SHORT when there are at most 65536 vertices
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    /* Set to false to always parse the source files */
+    static bool useMeshCache;
+
+    /* Layout of the Drawables created afterwards, INTERLEAVED by default */
+    static VertexLayout vertexLayout;
+
+    /*
+    * Run optimizeMesh() on meshes loaded from files, optionally sorting
+    * triangle clusters against overdraw as well. Caches made with other
+    * settings are rebuilt.
+    */
+    static bool optimizeMeshes;
+    static bool optimizeOverdraw;
 
 private:
     void createContext();
+    void createContext(const MeshCache& cache);
+    void createContext(MeshData& data);
+    void upload();
+    void uploadIndices(size_t vertexCount, const char* rawIndices = NULL, int indexSize = 0);
 };
 
 #endif
@@ -0,0 +1,241 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "animation.h"
+
+using namespace std;
+
+static const uint32_t CLIP_MAGIC = 0x50494c43;  // "CLIP"
+static const uint32_t CLIP_VERSION = 1;
+
+void AnimationTrack::reduce(float tolerance) {
+    if (times.size() <= 2) return;
+
+    // greedy: extend each segment while it stays within tolerance of the
+    // keys it skips
+    vector<float> keptTimes(1, times[0]), keptValues(1, values[0]);
+    size_t start = 0;
+    for (size_t end = 2; end < times.size(); end++) {
+        bool fits = true;
+        for (size_t i = start + 1; i < end && fits; i++) {
+            float t = (times[i] - times[start]) / (times[end] - times[start]);
+            float value = values[start] + t * (values[end] - values[start]);
+            fits = fabs(value - values[i]) <= tolerance;
+        }
+        if (!fits) {
+            start = end - 1;
+            keptTimes.push_back(times[start]);
+            keptValues.push_back(values[start]);
+        }
+    }
+    keptTimes.push_back(times.back());
+    keptValues.push_back(values.back());
+    times.swap(keptTimes);
+    values.swap(keptValues);
+}
+
+float AnimationClip::duration() const {
+    float duration = 0.0f;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        if (!tracks[i].times.empty()) {
+            duration = std::max(duration, tracks[i].times.back());
+        }
+    }
+    return duration;
+}
+
+AnimationClip loadMOT(const string& path, const map<string, int>& columns) {
+    ifstream file(path.c_str());
+    if (!file.good()) {
+        throw runtime_error("Can't open motion: " + path);
+    }
+
+    string line;
+    while (getline(file, line) && line.compare(0, 9, "endheader") != 0) {}
+    if (!getline(file, line)) {
+        throw runtime_error("Motion without data: " + path);
+    }
+
+    // the track of each column, -1 for ignored columns and the time
+    AnimationClip clip;
+    vector<int> trackOfColumn;
+    stringstream labels(line);
+    string label;
+    while (labels >> label) {
+        map<string, int>::const_iterator column = columns.find(label);
+        if (column == columns.end() || trackOfColumn.empty()) {
+            trackOfColumn.push_back(-1);
+        } else {
+            trackOfColumn.push_back(clip.tracks.size());
+            clip.tracks.push_back(AnimationTrack());
+            clip.tracks.back().coordinate = column->second;
+        }
+    }
+
+    float startTime = 0.0f;
+    bool first = true;
+    while (getline(file, line)) {
+        stringstream row(line);
+        float time;
+        if (!(row >> time)) continue;
+        if (first) {
+            startTime = time;
+            first = false;
+        }
+        for (size_t c = 1; c < trackOfColumn.size(); c++) {
+            float value;
+            if (!(row >> value)) {
+                throw runtime_error("Short motion row: " + path);
+            }
+            if (trackOfColumn[c] >= 0) {
+                AnimationTrack& track = clip.tracks[trackOfColumn[c]];
+                track.times.push_back(time - startTime);
+                track.values.push_back(value);
+            }
+        }
+    }
+    return clip;
+}
+
+vector<char> compressClip(const AnimationClip& clip, float tolerance) {
+    size_t size = sizeof(ClipHeader) + clip.tracks.size() * sizeof(ClipTrackHeader);
+    vector<AnimationTrack> tracks(clip.tracks);
+    vector<ClipTrackHeader> headers(tracks.size());
+    for (size_t i = 0; i < tracks.size(); i++) {
+        AnimationTrack& track = tracks[i];
+        if (track.times.empty() || track.times.size() != track.values.size()) {
+            throw runtime_error("Animation track without matching keys");
+        }
+        track.reduce(tolerance);
+
+        float minimum = *min_element(track.values.begin(), track.values.end());
+        float maximum = *max_element(track.values.begin(), track.values.end());
+        headers[i].coordinate = track.coordinate;
+        headers[i].keyCount = track.times.size();
+        headers[i].offset = size;
+        headers[i].minimum = minimum;
+        headers[i].scale = (maximum - minimum) / 65535.0f;
+        size += track.times.size() * (sizeof(float) + sizeof(uint16_t));
+        size = (size + 3) & ~(size_t) 3;
+    }
+
+    vector<char> data(size, 0);
+    ClipHeader header = { CLIP_MAGIC, CLIP_VERSION, (uint32_t) tracks.size(), clip.duration() };
+    memcpy(&data[0], &header, sizeof(header));
+    for (size_t i = 0; i < tracks.size(); i++) {
+        const ClipTrackHeader& h = headers[i];
+        memcpy(&data[sizeof(header) + i * sizeof(ClipTrackHeader)], &h, sizeof(h));
+        memcpy(&data[h.offset], &tracks[i].times[0], h.keyCount * sizeof(float));
+        char* values = &data[h.offset + h.keyCount * sizeof(float)];
+        for (uint32_t k = 0; k < h.keyCount; k++) {
+            float quantized = h.scale > 0.0f ?
+                (tracks[i].values[k] - h.minimum) / h.scale : 0.0f;
+            uint16_t value = (uint16_t) std::min(65535.0f, floor(quantized + 0.5f));
+            memcpy(values + k * sizeof(uint16_t), &value, sizeof(value));
+        }
+    }
+    return data;
+}
+
+void writeClip(const string& path, const AnimationClip& clip, float tolerance) {
+    vector<char> data = compressClip(clip, tolerance);
+    ofstream file(path.c_str(), ios::binary);
+    file.write(&data[0], data.size());
+    if (!file.good()) {
+        throw runtime_error("Can't write clip: " + path);
+    }
+}
+
+ClipPlayer::ClipPlayer(const string& path, int coordinates) {
+    file = new MappedFile(path);
+    try {
+        open(file->data(), file->size(), coordinates);
+    } catch (...) {
+        delete file;
+        throw;
+    }
+}
+
+ClipPlayer::ClipPlayer(const vector<char>& data, int coordinates) : memory(data) {
+    open(memory.empty() ? NULL : &memory[0], memory.size(), coordinates);
+}
+
+ClipPlayer::~ClipPlayer() {
+    delete file;
+}
+
+void ClipPlayer::open(const char* data, size_t size, int coordinates) {
+    // the size first, a short file has no header to read
+    if (size < sizeof(ClipHeader)) {
+        throw runtime_error("Not a clip");
+    }
+    base = data;
+    header = (const ClipHeader*) data;
+    tracks = (const ClipTrackHeader*) (data + sizeof(ClipHeader));
+    if (header->magic != CLIP_MAGIC ||
+        header->version != CLIP_VERSION ||
+        size < sizeof(ClipHeader) + (size_t) header->trackCount * sizeof(ClipTrackHeader)) {
+        throw runtime_error("Not a clip");
+    }
+    for (uint32_t i = 0; i < header->trackCount; i++) {
+        // sample() writes q[coordinate] unchecked
+        if (tracks[i].coordinate < 0 || tracks[i].coordinate >= coordinates ||
+            tracks[i].keyCount == 0 || tracks[i].offset % 4 != 0 ||
+            tracks[i].offset + (size_t) tracks[i].keyCount * 6 > size) {
+            throw runtime_error("Corrupt clip track");
+        }
+    }
+    cursors.assign(header->trackCount, 0);
+}
+
+void ClipPlayer::sample(float time, float* q, bool loop) {
+    float duration = header->duration;
+    if (loop && duration > 0.0f) {
+        time = fmod(time, duration);
+        if (time < 0.0f) time += duration;
+    }
+
+    for (uint32_t i = 0; i < header->trackCount; i++) {
+        const ClipTrackHeader& track = tracks[i];
+        const float* times = (const float*) (base + track.offset);
+        const uint16_t* values = (const uint16_t*) (times + track.keyCount);
+        uint32_t last = track.keyCount - 1;
+
+        if (time <= times[0] || last == 0) {
+            q[track.coordinate] = track.minimum + track.scale * values[0];
+            continue;
+        }
+        if (time >= times[last]) {
+            q[track.coordinate] = track.minimum + track.scale * values[last];
+            continue;
+        }
+
+        // key k such that times[k] <= time < times[k + 1], usually the last
+        // one or the next
+        uint32_t& k = cursors[i];
+        if (k >= last || times[k] > time) {
+            k = upper_bound(times, times + track.keyCount, time) - times - 1;
+        } else if (times[k + 1] <= time) {
+            if (k + 2 <= last && times[k + 2] > time) {
+                k++;
+            } else {
+                k = upper_bound(times + k + 1, times + track.keyCount, time) - times - 1;
+            }
+        }
+
+        float t = (time - times[k]) / (times[k + 1] - times[k]);
+        float a = track.minimum + track.scale * values[k];
+        float b = track.minimum + track.scale * values[k + 1];
+        q[track.coordinate] = a + t * (b - a);
+    }
+}
+
+void blendCoordinates(const float* a, const float* b, float weight, int count, float* out) {
+    for (int i = 0; i < count; i++) {
+        out[i] = a[i] + weight * (b[i] - a[i]);
+    }
+}
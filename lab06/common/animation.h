@@ -0,0 +1,104 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <stdint.h>
+#include "util.h"
+
+/**
+* Keyframes of one generalized coordinate, interpolated linearly. times are
+* in seconds and increasing.
+*/
+struct AnimationTrack {
+    int coordinate;
+    std::vector<float> times, values;
+
+    /* Drop the keys that interpolating their neighbors reproduces within tolerance */
+    void reduce(float tolerance);
+};
+
+/* Tracks of some coordinates over the same time span, as authored or loaded */
+struct AnimationClip {
+    std::vector<AnimationTrack> tracks;
+
+    float duration() const;
+};
+
+/**
+* Load an OpenSim .mot (or .sto) motion: a header ending with "endheader",
+* the column labels, then one row per frame starting with the time. columns
+* maps the labels to coordinates; other columns are ignored.
+*/
+AnimationClip loadMOT(const std::string& path, const std::map<std::string, int>& columns);
+
+/**
+* The compact binary form of a clip: the keys of each track are reduced
+* within tolerance and the values quantized to 16 bits over their range.
+* Layout: ClipHeader, trackCount ClipTrackHeaders, then the keys of each
+* track (keyCount float times, keyCount uint16 values, padded to 4 bytes).
+*/
+struct ClipHeader {
+    uint32_t magic, version, trackCount;
+    float duration;
+};
+
+struct ClipTrackHeader {
+    int32_t coordinate;
+    uint32_t keyCount;
+    uint32_t offset;  // of the times, from the start of the clip
+    float minimum, scale;  // value = minimum + scale * quantized
+};
+
+std::vector<char> compressClip(const AnimationClip& clip, float tolerance = 0.01f);
+
+/* Write compressClip() to a (.clip) file, throws on errors */
+void writeClip(const std::string& path, const AnimationClip& clip, float tolerance = 0.01f);
+
+/**
+* Samples a compressed clip into a flat array of coordinates. A .clip file
+* is memory mapped, so a long motion is paged in as it plays instead of
+* being read whole. Each track remembers the key it last sampled, so playing
+* forward costs no search; a jump falls back to a binary search.
+*/
+class ClipPlayer {
+public:
+    /*
+    * Play a .clip file into arrays of coordinate values, a track of any
+    * other coordinate is rejected as corrupt
+    */
+    ClipPlayer(const std::string& path, int coordinates);
+
+    /* Play the result of compressClip() */
+    ClipPlayer(const std::vector<char>& data, int coordinates);
+
+    ~ClipPlayer();
+
+    float duration() const { return header->duration; }
+
+    /*
+    * Write the value of every track at time into q[coordinate], other
+    * coordinates are left as they are. time wraps around when looping,
+    * else it is clamped to the clip.
+    */
+    void sample(float time, float* q, bool loop = true);
+
+private:
+    ClipPlayer(const ClipPlayer&);
+    ClipPlayer& operator=(const ClipPlayer&);
+
+    void open(const char* data, size_t size, int coordinates);
+
+    MappedFile* file = NULL;
+    std::vector<char> memory;
+    const ClipHeader* header;
+    const ClipTrackHeader* tracks;
+    const char* base;
+    std::vector<uint32_t> cursors;
+};
+
+/* out = (1 - weight) * a + weight * b, over count coordinates (out may be a or b) */
+void blendCoordinates(const float* a, const float* b, float weight, int count, float* out);
+
+#endif
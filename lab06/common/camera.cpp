@@ -123,4 +123,14 @@ void Camera::update() {
 
     // For the next frame, the "last time" will be "now"
     lastTime = currentTime;
+}
+
+void Camera::orbit(float angle) {
+    float radius = length(vec3(position.x, 0, position.z));
+    position = vec3(radius * sin(angle), position.y, radius * cos(angle));
+    horizontalAngle = angle + 3.14f;
+    verticalAngle = 0.0f;
+
+    projectionMatrix = perspective(radians(FoV), 4.0f / 3.0f, 0.1f, 100.0f);
+    viewMatrix = lookAt(position, vec3(0, 0, 0), vec3(0, 1, 0));
 }
\ No newline at end of file
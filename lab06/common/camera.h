@@ -25,6 +25,10 @@ public:
     Camera(GLFWwindow* window);
 
     void update();
+
+    /* Scripted instead of the mouse and keyboard: circle the origin at the
+    current distance and height, angle radians from +Z, looking at it */
+    void orbit(float angle);
 };
 
 #endif
\ No newline at end of file
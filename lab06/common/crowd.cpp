@@ -0,0 +1,97 @@
+#include "crowd.h"
+#include "skeleton.h"
+#include "skinning.h"
+#include "ModelLoader.h"
+
+using namespace glm;
+using namespace std;
+
+CrowdRenderer::CrowdRenderer(Skeleton* skeleton, GLuint shaderProgram) :
+    skeleton(skeleton) {
+    // a palette is just a texture buffer of matrices
+    buffer = new BonePalette(64 * (int) skeleton->bodies.size());
+
+    useInstancingLocation = glGetUniformLocation(shaderProgram, "useInstancing");
+    instanceTransformationsLocation = glGetUniformLocation(shaderProgram,
+        "instanceTransformations");
+    bodyCountLocation = glGetUniformLocation(shaderProgram, "bodyCount");
+    bodyIndexLocation = glGetUniformLocation(shaderProgram, "bodyIndex");
+
+    // the instances are read from unit 4, set once so that the samplerBuffer
+    // never shares unit 0 with the sampler2Ds
+    glUseProgram(shaderProgram);
+    glUniform1i(instanceTransformationsLocation, 4);
+}
+
+CrowdRenderer::~CrowdRenderer() {
+    delete buffer;
+}
+
+void CrowdRenderer::begin() {
+    // keeps the capacity, so a steady crowd does not allocate
+    transformations.clear();
+    spheres.clear();
+    instanceCount = 0;
+}
+
+void CrowdRenderer::addInstance(const mat4& modelMatrix) {
+    if (bodySpheres.size() != skeleton->bodies.size()) {
+        bodySpheres.clear();
+        for (const auto& body : skeleton->bodies) {
+            bodySpheres.push_back(body.second->boundingSphere());
+        }
+    }
+
+    skeleton->updateWorldTransformations();
+    int bodyIndex = 0;
+    BoundingSphere sphere = {vec3(0), 0};
+    for (const auto& body : skeleton->bodies) {
+        transformations.push_back(modelMatrix *
+            skeleton->worldTransformations[body.second->joint->slot]);
+        BoundingSphere bodySphere = transformSphere(bodySpheres[bodyIndex],
+            transformations.back());
+        sphere = bodyIndex++ == 0 ? bodySphere : mergeSpheres(sphere, bodySphere);
+    }
+    spheres.push_back(sphere);
+    instanceCount++;
+}
+
+void CrowdRenderer::draw(const mat4& viewMatrix, const mat4& projectionMatrix) {
+    int bodyCount = (int) skeleton->bodies.size();
+    if (instanceCount == 0 || bodyCount == 0) return;
+
+    // only the transformations of the visible instances are uploaded
+    int visibleCount = instanceCount;
+    const mat4* uploaded = &transformations[0];
+    if (Frustum::enabled) {
+        Frustum frustum(projectionMatrix * viewMatrix);
+        visibleTransformations.clear();
+        for (int i = 0; i < instanceCount; i++) {
+            if (frustum.intersects(spheres[i])) {
+                visibleTransformations.insert(visibleTransformations.end(),
+                    transformations.begin() + i * bodyCount,
+                    transformations.begin() + (i + 1) * bodyCount);
+            }
+        }
+        visibleCount = (int) visibleTransformations.size() / bodyCount;
+        uploaded = visibleTransformations.data();
+        cullingStats.culled += instanceCount - visibleCount;
+    }
+    cullingStats.drawn += visibleCount;
+    if (visibleCount == 0) return;
+
+    buffer->upload(uploaded, visibleCount * bodyCount);
+    buffer->bind(4);
+    glUniform1i(useInstancingLocation, 1);
+    glUniform1i(bodyCountLocation, bodyCount);
+
+    int bodyIndex = 0;
+    for (const auto& body : skeleton->bodies) {
+        glUniform1i(bodyIndexLocation, bodyIndex++);
+        for (Drawable* d : body.second->drawables) {
+            d->bind();
+            d->drawInstanced(visibleCount);
+        }
+    }
+    glUniform1i(useInstancingLocation, 0);
+}
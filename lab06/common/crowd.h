@@ -0,0 +1,58 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "culling.h"
+
+struct Skeleton;
+class BonePalette;
+
+/**
+* Draws many posed copies of a skeleton with one glDrawElementsInstanced per
+* drawable, instead of a draw and three uniform uploads per drawable and
+* instance. The body transformations of every instance go to a texture
+* buffer, read by the vertex shader at gl_InstanceID * bodyCount + bodyIndex.
+*
+* Each frame: begin(), then for every instance pose the skeleton and call
+* addInstance(), then draw(). Instances outside the view frustum are dropped
+* before the upload, counted in cullingStats.
+*/
+class CrowdRenderer {
+public:
+    CrowdRenderer(Skeleton* skeleton, GLuint shaderProgram);
+    ~CrowdRenderer();
+
+    void begin();
+
+    /* Add the skeleton in its current pose, placed by modelMatrix */
+    void addInstance(const glm::mat4& modelMatrix);
+
+    /* V and P as in the camera uniform block, to cull the instances */
+    void draw(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+
+    /* Instances added since begin(), drawn or not */
+    int instances() const { return instanceCount; }
+
+private:
+    CrowdRenderer(const CrowdRenderer&);
+    CrowdRenderer& operator=(const CrowdRenderer&);
+
+    Skeleton* skeleton;  // not owned
+    BonePalette* buffer;
+    // body transformations of every instance, instance by instance
+    std::vector<glm::mat4> transformations;
+    // a world space sphere around each instance, and the transformations of
+    // those in the view frustum
+    std::vector<BoundingSphere> spheres;
+    std::vector<glm::mat4> visibleTransformations;
+    // body space spheres of the bodies, as they are in skeleton->bodies
+    std::vector<BoundingSphere> bodySpheres;
+    int instanceCount = 0;
+
+    GLuint useInstancingLocation, instanceTransformationsLocation,
+        bodyCountLocation, bodyIndexLocation;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cmath>
+#include "culling.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULLING_SSE
+#endif
+
+using namespace glm;
+using namespace std;
+
+bool Frustum::enabled = true;
+CullingStats cullingStats;
+
+void calculateBounds(const vector<vec3>& points, BoundingBox& box,
+    BoundingSphere& sphere) {
+    if (points.empty()) {
+        box.minimum = box.maximum = sphere.center = vec3(0);
+        sphere.radius = 0;
+        return;
+    }
+
+    vec3 minimum = points[0], maximum = points[0];
+    size_t i = 0;
+#ifdef CULLING_SSE
+    // 4 points are 3 registers: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3, the
+    // lanes keep their coordinate so they are reduced to x, y and z at the end
+    const float* p = &points[0].x;
+    __m128 min0 = _mm_setr_ps(minimum.x, minimum.y, minimum.z, minimum.x), max0 = min0;
+    __m128 min1 = _mm_setr_ps(minimum.y, minimum.z, minimum.x, minimum.y), max1 = min1;
+    __m128 min2 = _mm_setr_ps(minimum.z, minimum.x, minimum.y, minimum.z), max2 = min2;
+    for (; i + 4 <= points.size(); i += 4, p += 12) {
+        __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+        min1 = _mm_min_ps(min1, b);
+        max1 = _mm_max_ps(max1, b);
+        min2 = _mm_min_ps(min2, c);
+        max2 = _mm_max_ps(max2, c);
+    }
+    float l[12], h[12];
+    _mm_storeu_ps(l, min0);
+    _mm_storeu_ps(l + 4, min1);
+    _mm_storeu_ps(l + 8, min2);
+    _mm_storeu_ps(h, max0);
+    _mm_storeu_ps(h + 4, max1);
+    _mm_storeu_ps(h + 8, max2);
+    for (int lane = 0; lane < 12; lane++) {
+        minimum[lane % 3] = std::min(minimum[lane % 3], l[lane]);
+        maximum[lane % 3] = std::max(maximum[lane % 3], h[lane]);
+    }
+#endif
+    for (; i < points.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            minimum[k] = std::min(minimum[k], points[i][k]);
+            maximum[k] = std::max(maximum[k], points[i][k]);
+        }
+    }
+    box.minimum = minimum;
+    box.maximum = maximum;
+
+    sphere.center = (minimum + maximum) * 0.5f;
+    float radius2 = 0;
+    for (size_t j = 0; j < points.size(); j++) {
+        vec3 d = points[j] - sphere.center;
+        radius2 = std::max(radius2, dot(d, d));
+    }
+    sphere.radius = sqrt(radius2);
+}
+
+BoundingSphere transformSphere(const BoundingSphere& sphere, const mat4& m) {
+    float scale2 = std::max(dot(vec3(m[0]), vec3(m[0])),
+        std::max(dot(vec3(m[1]), vec3(m[1])), dot(vec3(m[2]), vec3(m[2]))));
+    BoundingSphere transformed;
+    transformed.center = vec3(m * vec4(sphere.center, 1.0f));
+    transformed.radius = sphere.radius * sqrt(scale2);
+    return transformed;
+}
+
+BoundingSphere mergeSpheres(const BoundingSphere& a, const BoundingSphere& b) {
+    vec3 d = b.center - a.center;
+    float distance = length(d);
+    if (distance + b.radius <= a.radius) return a;
+    if (distance + a.radius <= b.radius) return b;
+
+    BoundingSphere merged;
+    merged.radius = (distance + a.radius + b.radius) * 0.5f;
+    merged.center = a.center + d * ((merged.radius - a.radius) / distance);
+    return merged;
+}
+
+Frustum::Frustum(const mat4& viewProjection) {
+    // rows of the matrix, glm is column major
+    vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = vec4(viewProjection[0][i], viewProjection[1][i],
+            viewProjection[2][i], viewProjection[3][i]);
+    }
+    // left, right, bottom, top, near, far
+    for (int i = 0; i < 3; i++) {
+        planes[2 * i] = rows[3] + rows[i];
+        planes[2 * i + 1] = rows[3] - rows[i];
+    }
+    for (int i = 0; i < 6; i++) {
+        planes[i] = planes[i] * (1.0f / length(vec3(planes[i])));
+    }
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const {
+    for (int i = 0; i < 6; i++) {
+        if (dot(vec3(planes[i]), sphere.center) + planes[i].w < -sphere.radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Frustum::intersects(const BoundingBox& box, const mat4& modelMatrix) const {
+    // the box is an oriented box in the space of the planes
+    vec3 center = vec3(modelMatrix * vec4((box.minimum + box.maximum) * 0.5f, 1.0f));
+    vec3 extent = (box.maximum - box.minimum) * 0.5f;
+    vec3 axes[3] = {
+        vec3(modelMatrix[0]) * extent.x,
+        vec3(modelMatrix[1]) * extent.y,
+        vec3(modelMatrix[2]) * extent.z
+    };
+    for (int i = 0; i < 6; i++) {
+        vec3 normal = vec3(planes[i]);
+        float radius = fabs(dot(normal, axes[0])) + fabs(dot(normal, axes[1])) +
+            fabs(dot(normal, axes[2]));
+        if (dot(normal, center) + planes[i].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
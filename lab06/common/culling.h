@@ -0,0 +1,59 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+struct BoundingBox {
+    glm::vec3 minimum, maximum;
+};
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+/**
+* The axis aligned box of points, with an SSE min/max reduction where
+* available, and the sphere around its center that contains them. Both are
+* zero sized at the origin if there are no points.
+*/
+void calculateBounds(const std::vector<glm::vec3>& points, BoundingBox& box,
+    BoundingSphere& sphere);
+
+/* A sphere containing sphere transformed by m, which may scale */
+BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& m);
+
+/* The smallest sphere containing a and b */
+BoundingSphere mergeSpheres(const BoundingSphere& a, const BoundingSphere& b);
+
+/**
+* The six planes of a view frustum, taken from viewProjection (Gribb and
+* Hartmann), in the space viewProjection transforms from. Volumes are culled
+* only when they are entirely outside one plane, so a few near the corners
+* are drawn although invisible.
+*/
+class Frustum {
+public:
+    Frustum(const glm::mat4& viewProjection);
+
+    bool intersects(const BoundingSphere& sphere) const;
+
+    /* box is in the space of modelMatrix, e.g. a Drawable's */
+    bool intersects(const BoundingBox& box, const glm::mat4& modelMatrix) const;
+
+    /* Set to false to draw everything, e.g. to measure what culling saves */
+    static bool enabled;
+
+private:
+    glm::vec4 planes[6];  // normal towards the inside, distance
+};
+
+/* Objects drawn and culled by the frustum tests, reset by the application */
+struct CullingStats {
+    int culled = 0, drawn = 0;
+};
+
+extern CullingStats cullingStats;
+
+#endif
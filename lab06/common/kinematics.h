@@ -0,0 +1,117 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+/**
+* A kinematic chain is a constant table of JointDefinitions, one per joint,
+* evaluated by KinematicChain<table, count>. The table is unrolled at compile
+* time: every axis and coordinate index is a constant, so a joint costs the
+* sine and cosine of its angles and a few column updates instead of a
+* translate() and a rotate() per axis multiplied as full 4x4 matrices.
+*/
+enum Axis { AXIS_X = 0, AXIS_Y, AXIS_Z };
+
+/* In place of a coordinate index: a fixed offset, or no rotation */
+const int NO_COORDINATE = -1;
+
+/**
+* The local transformation of a joint in the coordinates q:
+* translate(offset + q[translations]) * rotate(q[rotations[0]], axes[0]) *
+* rotate(q[rotations[1]], axes[1]) * rotate(q[rotations[2]], axes[2]), or the
+* rotations followed by the translation when rotateOffset is set. Angles are
+* in degrees.
+*/
+struct JointDefinition {
+    float offset[3];
+    int translations[3];
+    int rotations[3];
+    int axes[3];
+    bool rotateOffset;
+};
+
+namespace kinematics {
+    /* m = m * rotate(angle, axis), mixing the two columns the rotation touches */
+    template <int axis>
+    inline void rotate(glm::mat4& m, float angle) {
+        const int a = (axis + 1) % 3, b = (axis + 2) % 3;
+        float c = std::cos(angle), s = std::sin(angle);
+        glm::vec4 u = m[a], v = m[b];
+        m[a] = u * c + v * s;
+        m[b] = v * c - u * s;
+    }
+
+    template <int axis, int coordinate>
+    struct Rotation {
+        static void apply(glm::mat4& m, const float* q) {
+            rotate<axis>(m, glm::radians(q[coordinate]));
+        }
+    };
+
+    template <int axis>
+    struct Rotation<axis, NO_COORDINATE> {
+        static void apply(glm::mat4&, const float*) {}
+    };
+
+    template <int coordinate>
+    inline float translation(const float* q) {
+        return q[coordinate];
+    }
+
+    template <>
+    inline float translation<NO_COORDINATE>(const float*) {
+        return 0.0f;
+    }
+
+    template <const JointDefinition* chain, int joint>
+    inline glm::mat4 evaluateJoint(const float* q) {
+        glm::mat4 m(1.0f);
+        Rotation<chain[joint].axes[0], chain[joint].rotations[0]>::apply(m, q);
+        Rotation<chain[joint].axes[1], chain[joint].rotations[1]>::apply(m, q);
+        Rotation<chain[joint].axes[2], chain[joint].rotations[2]>::apply(m, q);
+        glm::vec4 offset(
+            chain[joint].offset[0] + translation<chain[joint].translations[0]>(q),
+            chain[joint].offset[1] + translation<chain[joint].translations[1]>(q),
+            chain[joint].offset[2] + translation<chain[joint].translations[2]>(q),
+            1.0f);
+        // the last column of translate(offset) * R is offset, of R * translate(offset) R * offset
+        m[3] = chain[joint].rotateOffset ? m * offset : offset;
+        return m;
+    }
+
+    template <const JointDefinition* chain, int joints, int joint>
+    struct Joints {
+        static void evaluate(const float* q, glm::mat4* local) {
+            local[joint] = evaluateJoint<chain, joint>(q);
+            Joints<chain, joints, joint + 1>::evaluate(q, local);
+        }
+    };
+
+    template <const JointDefinition* chain, int joints>
+    struct Joints<chain, joints, joints> {
+        static void evaluate(const float*, glm::mat4*) {}
+    };
+}
+
+/**
+* Evaluates the joints local transformations of the chain (a constexpr
+* JointDefinition array with internal or external linkage) for coordinate
+* vectors, one at a time or a batch of them, e.g. the frames of a motion.
+*/
+template <const JointDefinition* chain, int joints>
+struct KinematicChain {
+    /* q holds the coordinates, joints transformations are written to local */
+    static void evaluate(const float* q, glm::mat4* local) {
+        kinematics::Joints<chain, joints, 0>::evaluate(q, local);
+    }
+
+    /* poses coordinate vectors dofs floats apart, joints transformations each */
+    static void evaluate(const float* q, int dofs, int poses, glm::mat4* local) {
+        for (int i = 0; i < poses; i++) {
+            evaluate(q + i * dofs, local + i * joints);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <future>
+#include <algorithm>
+#include <memory>
+#include "obj.h"
+#include "parsing.h"
+#include "ThreadPool.h"
+
+using namespace glm;
+using namespace std;
+
+// smaller files are parsed on the calling thread
+const size_t MIN_OBJ_CHUNK = 1 << 20;
+
+/* A face corner, 0 based indices into the whole file, -1 for none */
+struct OBJCorner {
+    int position, uv, normal;
+};
+
+/**
+* A range of whole lines. The first pass counts its v, vt and vn lines, so
+* that the second one knows the index of its first ones in the whole file
+* and can resolve negative indices and write the attributes in place.
+*/
+struct OBJChunk {
+    const char* begin;
+    const char* end;
+    size_t positions = 0, uvs = 0, normals = 0;
+    size_t positionBase = 0, uvBase = 0, normalBase = 0;
+    vector<OBJCorner> corners;  // three per triangle
+};
+
+static inline const char* skipBlank(const char* p, const char* end) {
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+static inline const char* lineEnd(const char* p, const char* end) {
+    const char* found = (const char*) memchr(p, '\n', end - p);
+    return found == NULL ? end : found;
+}
+
+/* The start of the line after the one at p */
+static inline const char* nextLine(const char* p, const char* end) {
+    p = lineEnd(p, end);
+    return p == end ? end : p + 1;
+}
+
+/* The command at the start of a line: v, vt, vn, f or anything else */
+enum OBJCommand {
+    OBJ_POSITION, OBJ_UV, OBJ_NORMAL, OBJ_FACE, OBJ_OTHER
+};
+
+static inline OBJCommand command(const char*& p, const char* end) {
+    p = skipBlank(p, end);
+    if (end - p < 2) return OBJ_OTHER;
+    OBJCommand result;
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+        result = OBJ_POSITION;
+        p += 1;
+    } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+        result = OBJ_FACE;
+        p += 1;
+    } else if (p[0] == 'v' && p[1] == 't' && end - p > 2 && (p[2] == ' ' || p[2] == '\t')) {
+        result = OBJ_UV;
+        p += 2;
+    } else if (p[0] == 'v' && p[1] == 'n' && end - p > 2 && (p[2] == ' ' || p[2] == '\t')) {
+        result = OBJ_NORMAL;
+        p += 2;
+    } else {
+        return OBJ_OTHER;
+    }
+    return result;
+}
+
+static void countOBJChunk(OBJChunk& chunk) {
+    for (const char* p = chunk.begin, *next; p != chunk.end; p = next) {
+        next = nextLine(p, chunk.end);
+        switch (command(p, next)) {
+        case OBJ_POSITION: chunk.positions++; break;
+        case OBJ_UV: chunk.uvs++; break;
+        case OBJ_NORMAL: chunk.normals++; break;
+        default: break;
+        }
+    }
+}
+
+static const char* readFloats(const char* p, const char* end, float* out, int count,
+    int required) {
+    for (int i = 0; i < count; i++) {
+        p = skipBlank(p, end);
+        const char* next = parseFloat(p, end, out[i]);
+        if (next == p) {
+            if (i < required) throw runtime_error("Invalid number in .obj file");
+            out[i] = 0.0f;
+        }
+        p = next;
+    }
+    return p;
+}
+
+/* An obj index at p: 1 based, or negative relative to count */
+static const char* readIndex(const char* p, const char* end, size_t count, int& out) {
+    bool negative = p != end && *p == '-';
+    if (negative) ++p;
+    if (p == end || !isDigit(*p)) throw runtime_error("Invalid index in .obj file");
+    int64_t value = 0;
+    while (p != end && isDigit(*p)) {
+        if (value <= INT32_MAX) value = value * 10 + (*p - '0');
+        ++p;
+    }
+    if (value == 0) throw runtime_error("Invalid index in .obj file");
+    value = negative ? (int64_t) count - value : value - 1;
+    // out of range indices are rejected when the corners are welded
+    out = value < 0 || value > INT32_MAX ? INT32_MAX : (int) value;
+    return p;
+}
+
+static void parseOBJChunk(OBJChunk& chunk, vec3* positions, vec2* uvs, vec3* normals) {
+    size_t position = chunk.positionBase, uv = chunk.uvBase, normal = chunk.normalBase;
+    vector<OBJCorner> face;
+    for (const char* p = chunk.begin, *next; p != chunk.end; p = next) {
+        next = nextLine(p, chunk.end);
+        const char* end = lineEnd(p, next);
+        switch (command(p, end)) {
+        case OBJ_POSITION:
+            readFloats(p, end, &positions[position++].x, 3, 3);
+            break;
+        case OBJ_UV: {
+            vec2& t = uvs[uv++];
+            readFloats(p, end, &t.x, 2, 1);
+            t.y = 1 - t.y;
+            break;
+        }
+        case OBJ_NORMAL:
+            readFloats(p, end, &normals[normal++].x, 3, 3);
+            break;
+        case OBJ_FACE:
+            face.clear();
+            for (p = skipBlank(p, end); p != end && *p != '#'; p = skipBlank(p, end)) {
+                OBJCorner corner = {-1, -1, -1};
+                p = readIndex(p, end, position, corner.position);
+                if (p != end && *p == '/') {
+                    ++p;
+                    if (p != end && *p != '/') p = readIndex(p, end, uv, corner.uv);
+                    if (p != end && *p == '/') p = readIndex(p + 1, end, normal, corner.normal);
+                }
+                face.push_back(corner);
+            }
+            // fan triangulation
+            for (size_t i = 2; i < face.size(); i++) {
+                chunk.corners.push_back(face[0]);
+                chunk.corners.push_back(face[i - 1]);
+                chunk.corners.push_back(face[i]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/* Run task(i) for i < count, on the pool when there is one */
+template <typename Task>
+static void forEachChunk(ThreadPool* pool, size_t count, Task task) {
+    if (pool == NULL) {
+        for (size_t i = 0; i < count; i++) task(i);
+        return;
+    }
+    vector<future<void> > done;
+    for (size_t i = 0; i < count; i++) {
+        done.push_back(pool->submit([&task, i]() { task(i); }));
+    }
+    // wait for all of them before rethrowing, task refers to this frame
+    for (future<void>& f : done) f.wait();
+    for (future<void>& f : done) f.get();
+}
+
+static inline uint32_t hashCorner(const OBJCorner& c) {
+    uint32_t h = (uint32_t) c.position * 0x9e3779b1u;
+    h ^= (uint32_t) c.uv * 0x85ebca77u + (h << 6) + (h >> 2);
+    h ^= (uint32_t) c.normal * 0xc2b2ae3du + (h << 6) + (h >> 2);
+    return h ^ (h >> 15);
+}
+
+void parseOBJ(const char* data, size_t size,
+    vector<vec3>& vertices, vector<vec2>& uvs, vector<vec3>& normals,
+    vector<unsigned int>& indices, unsigned int threads) {
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    size_t chunkCount = max<size_t>(1, min<size_t>(threads, size / MIN_OBJ_CHUNK));
+
+    // cut at line ends
+    vector<OBJChunk> chunks(chunkCount);
+    const char* begin = data;
+    const char* end = data + size;
+    for (size_t i = 0; i < chunkCount; i++) {
+        chunks[i].begin = begin;
+        chunks[i].end = i + 1 == chunkCount ? end :
+            nextLine(max(begin, data + size / chunkCount * (i + 1)), end);
+        begin = chunks[i].end;
+    }
+
+    unique_ptr<ThreadPool> pool(chunkCount > 1 ? new ThreadPool(chunkCount) : NULL);
+    forEachChunk(pool.get(), chunkCount, [&chunks](size_t i) { countOBJChunk(chunks[i]); });
+
+    size_t positionCount = 0, uvCount = 0, normalCount = 0;
+    for (OBJChunk& chunk : chunks) {
+        chunk.positionBase = positionCount;
+        chunk.uvBase = uvCount;
+        chunk.normalBase = normalCount;
+        positionCount += chunk.positions;
+        uvCount += chunk.uvs;
+        normalCount += chunk.normals;
+    }
+    vector<vec3> filePositions(positionCount), fileNormals(normalCount);
+    vector<vec2> fileUVs(uvCount);
+    vec3* positionData = filePositions.data();
+    vec2* uvData = fileUVs.data();
+    vec3* normalData = fileNormals.data();
+    forEachChunk(pool.get(), chunkCount, [&](size_t i) {
+        parseOBJChunk(chunks[i], positionData, uvData, normalData);
+    });
+    pool.reset();
+
+    // weld the corners with an open addressing table of corner -> vertex
+    size_t cornerCount = 0;
+    for (const OBJChunk& chunk : chunks) cornerCount += chunk.corners.size();
+    size_t capacity = 16;
+    while (capacity < 2 * cornerCount) capacity <<= 1;
+    const unsigned int EMPTY = 0xffffffffu;
+    vector<unsigned int> slots(capacity, EMPTY);
+    // usually there are about as many vertices as positions
+    size_t expected = min(cornerCount, positionCount);
+    vector<OBJCorner> welded;
+    welded.reserve(expected);
+
+    size_t base = vertices.size();
+    bool hasUVs = false, hasNormals = false;
+    vector<vec2> vertexUVs;
+    vector<vec3> vertexNormals;
+    vertices.reserve(base + expected);
+    vertexUVs.reserve(expected);
+    vertexNormals.reserve(expected);
+    indices.reserve(indices.size() + cornerCount);
+    for (const OBJChunk& chunk : chunks) {
+        for (const OBJCorner& c : chunk.corners) {
+            size_t slot = hashCorner(c) & (capacity - 1);
+            while (slots[slot] != EMPTY) {
+                const OBJCorner& w = welded[slots[slot]];
+                if (w.position == c.position && w.uv == c.uv && w.normal == c.normal) break;
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (slots[slot] == EMPTY) {
+                if ((size_t) c.position >= positionCount ||
+                    (c.uv >= 0 && (size_t) c.uv >= uvCount) ||
+                    (c.normal >= 0 && (size_t) c.normal >= normalCount)) {
+                    throw runtime_error("Invalid index in .obj file");
+                }
+                slots[slot] = (unsigned int) welded.size();
+                welded.push_back(c);
+                vertices.push_back(filePositions[c.position]);
+                vertexUVs.push_back(c.uv >= 0 ? fileUVs[c.uv] : vec2(0));
+                vertexNormals.push_back(c.normal >= 0 ? fileNormals[c.normal] : vec3(0));
+                hasUVs = hasUVs || c.uv >= 0;
+                hasNormals = hasNormals || c.normal >= 0;
+            }
+            indices.push_back((unsigned int) (base + slots[slot]));
+        }
+    }
+
+    if (hasUVs) uvs.insert(uvs.end(), vertexUVs.begin(), vertexUVs.end());
+    if (hasNormals) normals.insert(normals.end(), vertexNormals.begin(), vertexNormals.end());
+}
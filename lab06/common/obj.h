@@ -0,0 +1,27 @@
+#ifndef OBJ_H
+#define OBJ_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/**
+* Parse the faces of a Wavefront .obj held in memory (e.g. a MappedFile) into
+* an indexed triangle mesh. Faces are polygons of any size, fan triangulated,
+* with v, v/vt, v//vn or v/vt/vn corners and negative (relative) indices.
+* Corners with the same v/vt/vn are welded as they are read, so the output
+* needs no indexVBO(). uvs (with v flipped, like loadOBJWithTiny()) and
+* normals stay empty when no corner has one, otherwise missing ones are 0.
+*
+* The text is cut at line ends into chunks of at least a megabyte, parsed by
+* up to threads threads (0 for every hardware thread). The arrays are
+* appended to. Throws on invalid numbers and indices.
+*/
+void parseOBJ(const char* data, size_t size,
+    std::vector<glm::vec3>& vertices,
+    std::vector<glm::vec2>& uvs,
+    std::vector<glm::vec3>& normals,
+    std::vector<unsigned int>& indices,
+    unsigned int threads = 0);
+
+#endif
@@ -0,0 +1,237 @@
+#include "offscreen.h"
+#include <glfw3.h>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <stdint.h>
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace std;
+
+#ifdef HAVE_EGL
+static EGLDisplay getDisplay() {
+    // the surfaceless platform of Mesa needs neither X11 nor a GPU
+    const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") &&
+        getPlatformDisplay) {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+            EGL_DEFAULT_DISPLAY, NULL);
+        if (display != EGL_NO_DISPLAY) return display;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+#endif
+
+OffscreenContext::OffscreenContext(int width, int height) :
+    width(width), height(height), hiddenWindow(NULL), display(NULL),
+    context(NULL), framebuffer(0), colorRenderbuffer(0), depthRenderbuffer(0) {
+#ifdef HAVE_EGL
+    EGLDisplay eglDisplay = getDisplay();
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        throw runtime_error("Failed to initialize EGL\n");
+    }
+
+    // no window, but the default surface type would ask for one
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) ||
+        configCount == 0 || !eglBindAPI(EGL_OPENGL_API)) {
+        eglTerminate(eglDisplay);
+        throw runtime_error("EGL has no desktop OpenGL configuration\n");
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT,
+        contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        eglTerminate(eglDisplay);
+        throw runtime_error("Failed to create a surfaceless OpenGL 3.3 context\n");
+    }
+    display = eglDisplay;
+    context = eglContext;
+#else
+    if (!glfwInit()) {
+        throw runtime_error("Failed to initialize GLFW\n");
+    }
+
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    hiddenWindow = glfwCreateWindow(width, height, "", NULL, NULL);
+    if (hiddenWindow == NULL) {
+        glfwTerminate();
+        throw runtime_error("Failed to open a hidden GLFW window\n");
+    }
+    glfwMakeContextCurrent(hiddenWindow);
+#endif
+}
+
+OffscreenContext::~OffscreenContext() {
+    if (framebuffer) {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colorRenderbuffer);
+        glDeleteRenderbuffers(1, &depthRenderbuffer);
+    }
+#ifdef HAVE_EGL
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+#else
+    glfwDestroyWindow(hiddenWindow);
+#endif
+}
+
+void OffscreenContext::bind() {
+    if (framebuffer == 0) {
+        glGenRenderbuffers(1, &colorRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_RENDERBUFFER, colorRenderbuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+            GL_RENDERBUFFER, depthRenderbuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw runtime_error("The offscreen framebuffer is incomplete\n");
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+}
+
+void OffscreenContext::readPixels(vector<unsigned char>& rgba) {
+    rgba.resize(width * height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &rgba[0]);
+}
+
+void OffscreenContext::savePNG(const string& path) {
+    vector<unsigned char> rgba;
+    readPixels(rgba);
+
+    // GL starts from the bottom row, PNG from the top one
+    int row = width * 4;
+    vector<unsigned char> flipped(rgba.size());
+    for (int y = 0; y < height; y++) {
+        memcpy(&flipped[y * row], &rgba[(height - 1 - y) * row], row);
+    }
+    writePNG(path, width, height, &flipped[0]);
+}
+
+static uint32_t crc(const unsigned char* data, size_t size, uint32_t c = 0xffffffff) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t k = n;
+            for (int i = 0; i < 8; i++) k = k & 1 ? 0xedb88320 ^ (k >> 1) : k >> 1;
+            table[n] = k;
+        }
+    }
+    for (size_t i = 0; i < size; i++) c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    return c;
+}
+
+static void putBigEndian(vector<unsigned char>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((value >> shift) & 0xff);
+}
+
+static void writeChunk(ofstream& out, const char* type, const vector<unsigned char>& data) {
+    vector<unsigned char> chunk;
+    putBigEndian(chunk, (uint32_t) data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, crc(&chunk[4], chunk.size() - 4) ^ 0xffffffff);
+    out.write((const char*) &chunk[0], chunk.size());
+}
+
+void writePNG(const string& path, int width, int height, const unsigned char* rgba) {
+    ofstream out(path.c_str(), ios::binary);
+    if (!out.is_open()) {
+        throw runtime_error("Can't write the PNG: " + path);
+    }
+
+    // each row is prefixed by its filter, none
+    int row = width * 4;
+    vector<unsigned char> scanlines;
+    scanlines.reserve((row + 1) * height);
+    for (int y = 0; y < height; y++) {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), rgba + y * row, rgba + (y + 1) * row);
+    }
+
+    vector<unsigned char> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.push_back(8);  // bits per channel
+    header.push_back(6);  // RGBA
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    // a zlib stream, compressed if zlib is available, else stored blocks
+    vector<unsigned char> data;
+#ifdef HAVE_ZLIB
+    uLongf size = compressBound(scanlines.size());
+    data.resize(size);
+    if (compress2(&data[0], &size, &scanlines[0], scanlines.size(), 6) != Z_OK) {
+        throw runtime_error("Can't compress the PNG: " + path);
+    }
+    data.resize(size);
+#else
+    data.push_back(0x78);
+    data.push_back(0x01);
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < scanlines.size(); i++) {
+        a = (a + scanlines[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    for (size_t offset = 0; offset < scanlines.size(); offset += 65535) {
+        size_t size = min(scanlines.size() - offset, (size_t) 65535);
+        data.push_back(offset + size == scanlines.size() ? 1 : 0);
+        data.push_back(size & 0xff);
+        data.push_back(size >> 8);
+        data.push_back(~size & 0xff);
+        data.push_back((~size >> 8) & 0xff);
+        data.insert(data.end(), scanlines.begin() + offset,
+            scanlines.begin() + offset + size);
+    }
+    putBigEndian(data, (b << 16) | a);
+#endif
+
+    static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    out.write((const char*) signature, 8);
+    writeChunk(out, "IHDR", header);
+    writeChunk(out, "IDAT", data);
+    writeChunk(out, "IEND", vector<unsigned char>());
+    if (!out) {
+        throw runtime_error("Can't write the PNG: " + path);
+    }
+}
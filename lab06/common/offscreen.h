@@ -0,0 +1,50 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+struct GLFWwindow;
+
+/**
+* A GL 3.3 core context that renders into a framebuffer object instead of a
+* window, for benchmarks and CI machines without a display. With EGL
+* (HAVE_EGL) the context is surfaceless and needs no display server, e.g.
+* Mesa's llvmpipe on a machine without a GPU. Otherwise it falls back to a
+* hidden GLFW window. The context is current after construction, GLEW is left
+* to the caller. The framebuffer is created by the first bind().
+*/
+class OffscreenContext {
+public:
+    OffscreenContext(int width, int height);
+    ~OffscreenContext();
+
+    /* The hidden window of the GLFW fallback, NULL with EGL */
+    GLFWwindow* window() const { return hiddenWindow; }
+
+    /* Render to the framebuffer object from now on */
+    void bind();
+
+    /* Read back the rendered frame (waits for it), bottom row first */
+    void readPixels(std::vector<unsigned char>& rgba);
+
+    /* Save the rendered frame as an RGBA PNG, throws on errors */
+    void savePNG(const std::string& path);
+
+private:
+    OffscreenContext(const OffscreenContext&);
+    OffscreenContext& operator=(const OffscreenContext&);
+
+    int width, height;
+    GLFWwindow* hiddenWindow;
+    void* display;
+    void* context;
+    GLuint framebuffer, colorRenderbuffer, depthRenderbuffer;
+};
+
+/* Write width x height RGBA pixels, top row first, as a PNG; throws on errors */
+void writePNG(const std::string& path, int width, int height,
+    const unsigned char* rgba);
+
+#endif
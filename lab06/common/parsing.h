@@ -0,0 +1,108 @@
+#ifndef PARSING_H
+#define PARSING_H
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+/*
+* Helpers of the text parsers (vtp.cpp, obj.cpp). They work on [p, end)
+* ranges of a mapped file, which are not null terminated.
+*/
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline const char* skipSpace(const char* p, const char* end) {
+    while (p != end && isSpace(*p)) ++p;
+    return p;
+}
+
+static const float POW10[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+/*
+* Parse a float starting at p. The result is rounded exactly like strtof.
+* Returns the end of the number, or p if there is no number at p.
+*/
+inline const char* parseFloat(const char* p, const char* end, float& out) {
+    const char* start = p;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0, significant = 0;
+    while (p != end && isDigit(*p)) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0) significant++;
+        } else {
+            exponent++;
+        }
+        digits++;
+        ++p;
+    }
+    if (p != end && *p == '.') {
+        ++p;
+        while (p != end && isDigit(*p)) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0) significant++;
+                exponent--;
+            }
+            digits++;
+            ++p;
+        }
+    }
+    if (digits != 0 && p != end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e != end && (*e == '-' || *e == '+')) {
+            negativeExponent = *e == '-';
+            ++e;
+        }
+        if (e != end && isDigit(*e)) {
+            int value = 0;
+            while (e != end && isDigit(*e)) {
+                if (value < 100000) value = value * 10 + (*e - '0');
+                ++e;
+            }
+            exponent += negativeExponent ? -value : value;
+            p = e;
+        }
+    }
+
+    // Both operands are exact in single precision, so the single IEEE
+    // operation gives the correctly rounded result.
+    if (digits != 0 && significant < 19 && mantissa < (1 << 24) &&
+        exponent >= -10 && exponent <= 10) {
+        float value = (float) mantissa;
+        value = exponent < 0 ? value / POW10[-exponent] : value * POW10[exponent];
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // slow path for long mantissas, large exponents, inf and nan; strtof
+    // needs a null terminated copy, as the range may end at the file end
+    char buffer[64];
+    size_t length = 0;
+    for (const char* c = start; c != end && length < sizeof(buffer) - 1 &&
+        !isSpace(*c) && *c != '/'; ++c) {
+        buffer[length++] = *c;
+    }
+    buffer[length] = '\0';
+    char* parsed;
+    out = strtof(buffer, &parsed);
+    return start + (parsed - buffer);
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "skeleton.h"
 #include "ModelLoader.h"
+#include "GeometryPool.h"
+#include <stdexcept>
 #include <glm/gtc/matrix_transform.hpp>
 
 void Joint::updateWorldTransformation() {
@@ -18,17 +20,8 @@ Body::~Body() {
     }
 }
 
-void Body::draw(
-    const GLuint& modelMatrixLocation,
-    const GLuint& viewMatrixLocation,
-    const GLuint& projectionMatrixLocation,
-    const glm::mat4 & viewMatrix, const glm::mat4 & projectionMatrix) {
-    joint->updateWorldTransformation();
-    glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE,
-        &joint->jointWorldTransformation[0][0]);
-    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-    glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE,
-        &projectionMatrix[0][0]);
+void Body::draw(const GLuint& modelMatrixLocation, const glm::mat4& modelMatrix) {
+    glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &modelMatrix[0][0]);
 
     for (Drawable* d : drawables) {
         d->bind();
@@ -36,16 +29,42 @@ void Body::draw(
     }
 }
 
-Skeleton::Skeleton(
-    GLuint modelMatrixLocation,
-    GLuint viewMatrixLocation,
-    GLuint projectionMatrixLocation) :
-    modelMatrixLocation(modelMatrixLocation),
-    viewMatrixLocation(viewMatrixLocation),
-    projectionMatrixLocation(projectionMatrixLocation) {
+void Body::draw(const GLuint& modelMatrixLocation, const glm::mat4& modelMatrix,
+    const Frustum& frustum) {
+    bool uploaded = false;
+    for (Drawable* d : drawables) {
+        if (!frustum.intersects(d->boundingBox, modelMatrix)) {
+            cullingStats.culled++;
+            continue;
+        }
+        if (!uploaded) {
+            glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &modelMatrix[0][0]);
+            uploaded = true;
+        }
+        d->bind();
+        d->draw();
+        cullingStats.drawn++;
+    }
+}
+
+BoundingSphere Body::boundingSphere() const {
+    BoundingSphere sphere = {glm::vec3(0), 0};
+    for (size_t i = 0; i < drawables.size(); i++) {
+        sphere = i == 0 ? drawables[i]->boundingSphere :
+            mergeSpheres(sphere, drawables[i]->boundingSphere);
+    }
+    return sphere;
+}
+
+bool Skeleton::useGeometryPool = true;
+
+Skeleton::Skeleton(GLuint modelMatrixLocation) :
+    modelMatrixLocation(modelMatrixLocation) {
 }
 
 Skeleton::~Skeleton() {
+    delete geometryPool;
+
     for (auto body : bodies) {
         delete body.second;
     }
@@ -55,29 +74,190 @@ Skeleton::~Skeleton() {
     }
 }
 
+void Skeleton::addJoint(int id, Joint* joint) {
+    Joint*& existing = joints[id];
+    if (existing != joint) {
+        delete existing;
+        existing = joint;
+    }
+    dirty = true;
+}
+
+void Skeleton::setParent(int joint, int parent) {
+    Joint* child = joints.at(joint);
+    child->parent = parent < 0 ? NULL : joints.at(parent);
+    dirty = true;
+}
+
+void Skeleton::build() {
+    // breadth first from the roots, so parents get lower slots than children
+    std::map<Joint*, int> ids;
+    std::map<Joint*, std::vector<Joint*>> children;
+    std::vector<Joint*> order;
+    for (const auto& joint : joints) {
+        if (joint.first < 0) {
+            throw std::runtime_error("Joint ids must not be negative");
+        }
+        ids[joint.second] = joint.first;
+    }
+    for (const auto& joint : joints) {
+        Joint* parent = joint.second->parent;
+        if (parent == NULL) {
+            order.push_back(joint.second);
+        } else if (ids.count(parent) == 0) {
+            throw std::runtime_error("Joint parent is not part of the skeleton");
+        } else {
+            children[parent].push_back(joint.second);
+        }
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        const std::vector<Joint*>& c = children[order[i]];
+        order.insert(order.end(), c.begin(), c.end());
+    }
+    if (order.size() != joints.size()) {
+        throw std::runtime_error("Skeleton joints form a cycle");
+    }
+
+    // keep the local and bind transformations of joints that already had a slot
+    std::vector<glm::mat4> previous(localTransformations),
+        previousInverseBind(inverseBindTransformations);
+    std::vector<int> previousSlots(jointSlots);
+    bool bound = !previousInverseBind.empty();
+
+    jointIds.resize(order.size());
+    slotJoints = order;
+    parentSlots.resize(order.size());
+    localTransformations.resize(order.size());
+    worldTransformations.resize(order.size());
+    inverseBindTransformations.resize(bound ? order.size() : 0);
+    jointSlots.assign(joints.empty() ? 0 : joints.rbegin()->first + 1, -1);
+    for (size_t i = 0; i < order.size(); i++) {
+        jointIds[i] = ids[order[i]];
+        jointSlots[jointIds[i]] = i;
+        order[i]->slot = i;
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        int id = jointIds[i];
+        parentSlots[i] = order[i]->parent == NULL ? -1 : jointSlots[ids[order[i]->parent]];
+        bool hadSlot = id < (int) previousSlots.size() && previousSlots[id] >= 0;
+        localTransformations[i] = hadSlot ?
+            previous[previousSlots[id]] : order[i]->jointLocalTransformation;
+        if (bound) {
+            inverseBindTransformations[i] = hadSlot ?
+                previousInverseBind[previousSlots[id]] : glm::mat4(1.0f);
+        }
+    }
+    dirty = false;
+}
+
+int Skeleton::slot(int joint) {
+    if (dirty) build();
+    if (joint < 0 || joint >= (int) jointSlots.size() || jointSlots[joint] < 0) {
+        throw std::out_of_range("Unknown joint");
+    }
+    return jointSlots[joint];
+}
+
 void Skeleton::setPose(const std::map<int, glm::mat4>& jointTransformations) {
     for (const auto& tran : jointTransformations) {
-        joints[tran.first]->jointLocalTransformation = tran.second;
+        int s = slot(tran.first);
+        localTransformations[s] = tran.second;
+        slotJoints[s]->jointLocalTransformation = tran.second;
+    }
+}
+
+void Skeleton::setPose(const glm::mat4* jointTransformations, int count) {
+    for (int i = 0; i < count; i++) {
+        int s = slot(i);
+        localTransformations[s] = jointTransformations[i];
+        slotJoints[s]->jointLocalTransformation = jointTransformations[i];
+    }
+}
+
+void Skeleton::updateWorldTransformations() {
+    if (dirty) build();
+
+    const int* parent = parentSlots.data();
+    const glm::mat4* local = localTransformations.data();
+    glm::mat4* world = worldTransformations.data();
+    for (size_t i = 0, n = jointIds.size(); i < n; i++) {
+        world[i] = parent[i] < 0 ? local[i] : world[parent[i]] * local[i];
+    }
+}
+
+void Skeleton::buildGeometryPool(GLuint shaderProgram) {
+    delete geometryPool;
+    geometryPool = new GeometryPool(shaderProgram);
+    for (const auto& body : bodies) {
+        for (Drawable* d : body.second->drawables) {
+            geometryPool->add(*d);
+        }
+    }
+    geometryPool->build();
+}
+
+void Skeleton::bind() {
+    updateWorldTransformations();
+    inverseBindTransformations.resize(jointIds.size());
+    for (size_t i = 0; i < jointIds.size(); i++) {
+        inverseBindTransformations[i] = glm::inverse(worldTransformations[i]);
+        slotJoints[i]->jointBindTransformation = worldTransformations[i];
+    }
+}
+
+void Skeleton::updateSkinningPalette(glm::mat4* palette) {
+    updateWorldTransformations();
+    if (inverseBindTransformations.size() != jointIds.size()) {
+        throw std::logic_error("Skeleton::bind() must be called before skinning");
+    }
+
+    for (size_t i = 0, n = jointIds.size(); i < n; i++) {
+        palette[jointIds[i]] = worldTransformations[i] * inverseBindTransformations[i];
     }
 }
 
 void Skeleton::draw(const glm::mat4 & viewMatrix, const glm::mat4 & projectionMatrix) {
+    updateWorldTransformations();
+
+    Frustum frustum(projectionMatrix * viewMatrix);
+    bool pooled = geometryPool != NULL && useGeometryPool;
+    if (pooled) geometryPool->begin();
+    // the pool holds the meshes body by body, drawable by drawable
+    int mesh = 0;
     for (auto& body : bodies) {
-        body.second->draw(modelMatrixLocation, viewMatrixLocation,
-            projectionMatrixLocation, viewMatrix, projectionMatrix);
+        int slot = body.second->joint->slot;
+        if (slot < 0) {
+            throw std::runtime_error("Body joint is not part of the skeleton");
+        }
+        if (pooled) {
+            const glm::mat4& modelMatrix = worldTransformations[slot];
+            for (size_t i = 0; i < body.second->drawables.size(); i++, mesh++) {
+                if (Frustum::enabled &&
+                    !frustum.intersects(geometryPool->boundingBox(mesh), modelMatrix)) {
+                    cullingStats.culled++;
+                    continue;
+                }
+                geometryPool->queue(mesh, modelMatrix);
+                cullingStats.drawn++;
+            }
+        } else if (Frustum::enabled) {
+            body.second->draw(modelMatrixLocation, worldTransformations[slot], frustum);
+        } else {
+            body.second->draw(modelMatrixLocation, worldTransformations[slot]);
+        }
     }
+    if (pooled) geometryPool->draw();
 }
 
 std::map<int, glm::mat4> Skeleton::getJointWorldTransformations() {
     std::map<int, glm::mat4> jointWorldTransformations;
     // update before computing
-    for (auto joint : joints) {
-        joint.second->updateWorldTransformation();
-    }
+    updateWorldTransformations();
 
-    for (auto joint : joints) {
-        jointWorldTransformations[joint.first] = joint.second->jointWorldTransformation;
+    for (size_t i = 0; i < jointIds.size(); i++) {
+        jointWorldTransformations[jointIds[i]] = worldTransformations[i];
+        slotJoints[i]->jointWorldTransformation = worldTransformations[i];
     }
 
     return  jointWorldTransformations;
-}
\ No newline at end of file
+}
@@ -5,11 +5,14 @@
 #include <vector>
 #include <map>
 #include <glm/glm.hpp>
+#include "culling.h"
 
 class Drawable;
+class GeometryPool;
 
 struct Joint {
     Joint* parent = NULL;
+    int slot = -1;  // set by Skeleton::build()
     glm::mat4 jointLocalTransformation, jointWorldTransformation,
         jointBindTransformation;
 
@@ -26,37 +29,110 @@ struct Body {
     /* Free all drawables (a body can have many drawables)*/
     ~Body();
 
-    /* Given the view and projection matrix draw every attached drawables */
-    void draw(
-        const GLuint& modelMatrixLocation,
-        const GLuint& viewMatrixLocation,
-        const GLuint& projectionMatrixLocation,
-        const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+    /* Draw every attached drawable with the given model matrix (M) */
+    void draw(const GLuint& modelMatrixLocation, const glm::mat4& modelMatrix);
+
+    /* Draw the drawables that intersect frustum, counted in cullingStats */
+    void draw(const GLuint& modelMatrixLocation, const glm::mat4& modelMatrix,
+        const Frustum& frustum);
+
+    /* A sphere around every attached drawable, in the space of the body */
+    BoundingSphere boundingSphere() const;
 };
 
+/**
+* The joints and bodies are described with the maps below, like before. The
+* pose itself lives in flat arrays of slots, ordered so that a parent always
+* precedes its children, so the world transformations are computed in a
+* single pass without allocations, and every draw takes its model matrix
+* from them. The slots are rebuilt on their next use after addJoint() or
+* setParent(); call invalidate() after editing joints or parent directly.
+*/
 struct Skeleton {
     std::map<int, Body*> bodies;
     std::map<int, Joint*> joints;
 
-    // shader locations to M, V, P
-    GLuint modelMatrixLocation, viewMatrixLocation, projectionMatrixLocation;
+    // shader location to M, V and P are in the camera uniform block
+    GLuint modelMatrixLocation;
+
+    // flat pose, indexed by slot
+    std::vector<int> jointIds;      // joint id of each slot
+    std::vector<Joint*> slotJoints; // joint of each slot, no map lookups
+    std::vector<int> parentSlots;   // slot of the parent, -1 for a root
+    std::vector<glm::mat4> localTransformations, worldTransformations;
+    // inverse world transformations at the binding pose, see bind()
+    std::vector<glm::mat4> inverseBindTransformations;
+    // slot of each joint id, -1 for unused ids
+    std::vector<int> jointSlots;
+
+    // every drawable of every body in one buffer, see buildGeometryPool()
+    GeometryPool* geometryPool = NULL;  // owned
+
+    /* Draw with the geometry pool, once it is built */
+    static bool useGeometryPool;
 
-    Skeleton(
-        GLuint modelMatrixLocation,
-        GLuint viewMatrixLocation,
-        GLuint projectionMatrixLocation);
+    // the slots no longer match the joints
+    bool dirty = true;
+
+    Skeleton(GLuint modelMatrixLocation);
 
     /* Free all bodies and joints*/
     ~Skeleton();
 
+    /* Add joint as id, replacing (and freeing) a previous joint with that id */
+    void addJoint(int id, Joint* joint);
+
+    /* Attach joint to parent, -1 makes it a root */
+    void setParent(int joint, int parent);
+
+    /* Rebuild the slots on their next use */
+    void invalidate() { dirty = true; }
+
+    /* (Re)build the slots from the joints, keeping their local transformations */
+    void build();
+
+    /* Slot of a joint id, builds the slots if they are out of date */
+    int slot(int joint);
+
     /* Update joint local coordinates */
     void setPose(const std::map<int, glm::mat4>& jointTransformations);
 
-    /* Given the view and projection matrix draw every attached drawables */
+    /* Update the local coordinates of joints 0 to count - 1 */
+    void setPose(const glm::mat4* jointTransformations, int count);
+
+    /* Update one joint's local transformation without going through a map */
+    void setLocalTransformation(int joint, const glm::mat4& transformation) {
+        localTransformations[slot(joint)] = transformation;
+    }
+
+    /* Compute every worldTransformations slot from the local ones */
+    void updateWorldTransformations();
+
+    /*
+    * Pack the drawables of every body into a GeometryPool, so draw() issues a
+    * single multi-draw instead of a bind and a draw per drawable. Call again
+    * after attaching or removing drawables. The drawables keep their own
+    * buffers, which the CrowdRenderer and the per-drawable path (key 6)
+    * still draw, so the pool doubles the skeleton's vertex memory.
+    */
+    void buildGeometryPool(GLuint shaderProgram);
+
+    /* Take the current pose as the binding pose of the skin */
+    void bind();
+
+    /*
+    * Write the skinning transformation (world * inverse bind) of each joint
+    * at palette[joint id], ready for glUniformMatrix4fv. palette must hold
+    * jointSlots.size() matrices. Does not allocate.
+    */
+    void updateSkinningPalette(glm::mat4* palette);
+
+    /* Draw every attached drawable; the camera uniform block must hold the
+    same view and projection, they are only used for frustum culling here */
     void draw(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
 
     /* Get joint world transformations after setting the pose */
     std::map<int, glm::mat4> getJointWorldTransformations();
 };
 
-#endif
\ No newline at end of file
+#endif
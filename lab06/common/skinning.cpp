@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include "skinning.h"
+#include "skeleton.h"
+#include "ThreadPool.h"
+#include "ModelLoader.h"
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SKINNING_SSE
+#endif
+
+using namespace glm;
+using namespace std;
+
+void calculateDualQuaternions(
+    const mat4* transformations,
+    DualQuaternion* dualQuaternions,
+    int count) {
+    for (int i = 0; i < count; i++) {
+        quat real = normalize(quat_cast(mat3(transformations[i])));
+        vec3 t = vec3(transformations[i][3]);
+        quat dual = quat(0.0f, t.x, t.y, t.z) * real * 0.5f;
+        dualQuaternions[i].real = vec4(real.x, real.y, real.z, real.w);
+        dualQuaternions[i].dual = vec4(dual.x, dual.y, dual.z, dual.w);
+    }
+}
+
+vector<BoneSegment> calculateBoneSegments(const Skeleton& skeleton) {
+    vector<BoneSegment> segments;
+    for (const auto& joint : skeleton.joints) {
+        BoneSegment segment;
+        segment.joint = joint.first;
+        segment.start = vec3(joint.second->jointBindTransformation[3]);
+
+        vec3 children(0.0f);
+        int count = 0;
+        for (const auto& child : skeleton.joints) {
+            if (child.second->parent == joint.second) {
+                children += vec3(child.second->jointBindTransformation[3]);
+                count++;
+            }
+        }
+        // a joint without children is a point
+        segment.end = count == 0 ? segment.start : children / (float) count;
+        segments.push_back(segment);
+    }
+    return segments;
+}
+
+static float distanceToSegment(const vec3& p, const BoneSegment& segment) {
+    vec3 direction = segment.end - segment.start;
+    float lengthSquared = dot(direction, direction);
+    float t = lengthSquared > 0.0f ?
+        clamp(dot(p - segment.start, direction) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+    return length(p - (segment.start + t * direction));
+}
+
+static void calculateSkinningWeights(
+    const vector<vec3>& vertices,
+    const vector<BoneSegment>& segments,
+    vector<VertexInfluences>& influences,
+    size_t begin, size_t end) {
+    for (size_t v = begin; v < end; v++) {
+        // the strongest influences, kept sorted by descending weight
+        float weights[MAX_BONE_INFLUENCES] = {};
+        int bones[MAX_BONE_INFLUENCES] = {};
+        for (size_t s = 0; s < segments.size(); s++) {
+            float d = std::max(distanceToSegment(vertices[v], segments[s]), 1e-4f);
+            float weight = 1.0f / (d * d * d * d);
+            int i = MAX_BONE_INFLUENCES;
+            while (i > 0 && weights[i - 1] < weight) i--;
+            if (i == MAX_BONE_INFLUENCES) continue;
+            for (int j = MAX_BONE_INFLUENCES - 1; j > i; j--) {
+                weights[j] = weights[j - 1];
+                bones[j] = bones[j - 1];
+            }
+            weights[i] = weight;
+            bones[i] = segments[s].joint;
+        }
+
+        // quantize so the bytes sum up to exactly 255
+        float sum = 0.0f;
+        for (int i = 0; i < MAX_BONE_INFLUENCES; i++) sum += weights[i];
+        VertexInfluences& influence = influences[v];
+        int total = 0;
+        for (int i = 0; i < MAX_BONE_INFLUENCES; i++) {
+            int weight = sum > 0.0f ? (int) floor(weights[i] / sum * 255.0f + 0.5f) : 0;
+            influence.bones[i] = (uint8_t) bones[i];
+            influence.weights[i] = (uint8_t) weight;
+            total += weight;
+        }
+        influence.weights[0] = (uint8_t) (influence.weights[0] + 255 - total);
+    }
+}
+
+void calculateSkinningWeights(
+    const vector<vec3>& vertices,
+    const vector<BoneSegment>& segments,
+    vector<VertexInfluences>& influences) {
+    for (size_t s = 0; s < segments.size(); s++) {
+        if (segments[s].joint < 0 || segments[s].joint > 255) {
+            throw runtime_error("Bone ids must fit in a byte");
+        }
+    }
+    influences.resize(vertices.size());
+    if (segments.empty()) {
+        VertexInfluences none = {};
+        fill(influences.begin(), influences.end(), none);
+        return;
+    }
+
+    ThreadPool pool;
+    size_t chunks = pool.size() * 4;
+    size_t chunk = (vertices.size() + chunks - 1) / chunks;
+    vector<future<void>> done;
+    for (size_t begin = 0; begin < vertices.size(); begin += chunk) {
+        size_t end = std::min(begin + chunk, vertices.size());
+        done.push_back(pool.submit([&vertices, &segments, &influences, begin, end]() {
+            calculateSkinningWeights(vertices, segments, influences, begin, end);
+        }));
+    }
+    for (size_t i = 0; i < done.size(); i++) {
+        done[i].get();
+    }
+}
+
+GLuint uploadSkinningInfluences(GLuint VAO, const vector<VertexInfluences>& influences) {
+    GLuint VBO;
+    glBindVertexArray(VAO);
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, influences.size() * sizeof(VertexInfluences),
+        influences.empty() ? NULL : &influences[0], GL_STATIC_DRAW);
+    glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(VertexInfluences),
+        (void*) offsetof(VertexInfluences, bones));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(VertexInfluences),
+        (void*) offsetof(VertexInfluences, weights));
+    glEnableVertexAttribArray(5);
+    return VBO;
+}
+
+BonePalette::BonePalette(int bones) : bones(bones) {
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bones * sizeof(mat4), NULL, GL_STREAM_DRAW);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+}
+
+BonePalette::~BonePalette() {
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+}
+
+void BonePalette::upload(const mat4* transformations, int count) {
+    uploadData(transformations, count * sizeof(mat4));
+}
+
+void BonePalette::upload(const DualQuaternion* transformations, int count) {
+    uploadData(transformations, count * sizeof(DualQuaternion));
+}
+
+void BonePalette::uploadData(const void* data, size_t size) {
+    bones = std::max(bones, (int) ((size + sizeof(mat4) - 1) / sizeof(mat4)));
+    // orphan the storage so the draws of the previous frame don't stall us
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, bones * sizeof(mat4), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
+
+void BonePalette::bind(int textureUnit) {
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+bool SkinnedMesh::useSIMD = true;
+
+SkinnedMesh::SkinnedMesh(Drawable* drawable, const vector<VertexInfluences>& influences) :
+    drawable(drawable), influences(influences) {
+    const vector<vec3>& vertices = drawable->indexedVertices;
+    const vector<vec3>& normals = drawable->indexedNormals;
+    if (influences.size() != vertices.size()) {
+        throw runtime_error("Every vertex needs its influences");
+    }
+
+    size_t n = vertices.size();
+    px.resize(n); py.resize(n); pz.resize(n);
+    nx.assign(n, 0.0f); ny.assign(n, 0.0f); nz.assign(n, 0.0f);
+    for (size_t v = 0; v < n; v++) {
+        px[v] = vertices[v].x; py[v] = vertices[v].y; pz[v] = vertices[v].z;
+        if (!normals.empty()) {
+            nx[v] = normals[v].x; ny[v] = normals[v].y; nz[v] = normals[v].z;
+        }
+    }
+    // the SSE path stores 4 floats at a time
+    skinned.resize(6 * n + 1);
+
+    // positions and normals from our VBO, uvs and indices as the drawable has them
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+
+    GLint uvBuffer = 0, uvEnabled = 0, uvSize = 0, uvType = 0, uvNormalized = 0, uvStride = 0;
+    void* uvPointer = NULL;
+    glBindVertexArray(drawable->VAO);
+    glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &uvEnabled);
+    glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &uvBuffer);
+    glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_SIZE, &uvSize);
+    glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_TYPE, &uvType);
+    glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_NORMALIZED, &uvNormalized);
+    glGetVertexAttribiv(2, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &uvStride);
+    glGetVertexAttribPointerv(2, GL_VERTEX_ATTRIB_ARRAY_POINTER, &uvPointer);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, n * 6 * sizeof(float), NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), NULL);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float),
+        (void*) (3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    if (uvEnabled) {
+        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
+        glVertexAttribPointer(2, uvSize, uvType, (GLboolean) uvNormalized, uvStride,
+            uvPointer);
+        glEnableVertexAttribArray(2);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable->elementVBO);
+    glBindVertexArray(0);
+}
+
+SkinnedMesh::~SkinnedMesh() {
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+}
+
+void SkinnedMesh::skin(const mat4* palette) {
+    size_t n = px.size();
+    float* out = &skinned[0];
+    const float scale = 1.0f / 255.0f;
+
+#ifdef SKINNING_SSE
+    if (useSIMD) {
+        for (size_t v = 0; v < n; v++, out += 6) {
+            const VertexInfluences& influence = influences[v];
+            __m128 c[4];
+            for (int k = 0; k < MAX_BONE_INFLUENCES; k++) {
+                __m128 w = _mm_set1_ps(influence.weights[k] * scale);
+                const float* m = &palette[influence.bones[k]][0][0];
+                for (int i = 0; i < 4; i++) {
+                    __m128 column = _mm_mul_ps(w, _mm_loadu_ps(m + 4 * i));
+                    c[i] = k == 0 ? column : _mm_add_ps(c[i], column);
+                }
+            }
+
+            __m128 position = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(c[0], _mm_set1_ps(px[v])),
+                _mm_mul_ps(c[1], _mm_set1_ps(py[v]))),
+                _mm_mul_ps(c[2], _mm_set1_ps(pz[v]))), c[3]);
+            __m128 normal = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(c[0], _mm_set1_ps(nx[v])),
+                _mm_mul_ps(c[1], _mm_set1_ps(ny[v]))),
+                _mm_mul_ps(c[2], _mm_set1_ps(nz[v])));
+            // the normal overwrites the position's w
+            _mm_storeu_ps(out, position);
+            _mm_storeu_ps(out + 3, normal);
+        }
+        return;
+    }
+#endif
+
+    for (size_t v = 0; v < n; v++, out += 6) {
+        const VertexInfluences& influence = influences[v];
+        float c[16];
+        for (int k = 0; k < MAX_BONE_INFLUENCES; k++) {
+            float w = influence.weights[k] * scale;
+            const float* m = &palette[influence.bones[k]][0][0];
+            for (int i = 0; i < 16; i++) {
+                c[i] = k == 0 ? w * m[i] : c[i] + w * m[i];
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            out[i] = c[i] * px[v] + c[4 + i] * py[v] + c[8 + i] * pz[v] + c[12 + i];
+            out[3 + i] = c[i] * nx[v] + c[4 + i] * ny[v] + c[8 + i] * nz[v];
+        }
+    }
+}
+
+void SkinnedMesh::upload() {
+    // orphan the storage so the draws of the previous frame don't stall us
+    size_t size = px.size() * 6 * sizeof(float);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, &skinned[0]);
+}
+
+void SkinnedMesh::bind() {
+    glBindVertexArray(VAO);
+}
+
+void SkinnedMesh::draw(int mode) {
+    glDrawElements(mode, drawable->indices.size(), drawable->indexType, NULL);
+}
@@ -0,0 +1,136 @@
+#ifndef SKINNING_H
+#define SKINNING_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+struct Skeleton;
+class Drawable;
+
+const int MAX_BONE_INFLUENCES = 4;
+
+/**
+* Up to 4 bones of a vertex, uploaded as a uvec4 of bone (joint) ids and a
+* vec4 of normalized weights, one byte each. Unused influences have weight 0.
+*/
+struct VertexInfluences {
+    uint8_t bones[MAX_BONE_INFLUENCES];
+    uint8_t weights[MAX_BONE_INFLUENCES];  // sum up to 255
+};
+
+/**
+* A rigid transformation as a unit dual quaternion (x, y, z, w components):
+* real holds the rotation and dual = 0.5 * translation * real. Half the size
+* of a mat4, and blending them does not collapse joints like matrices do.
+*/
+struct DualQuaternion {
+    glm::vec4 real, dual;
+};
+
+/* Convert rigid transformations (e.g. a skinning palette) to dual quaternions */
+void calculateDualQuaternions(
+    const glm::mat4* transformations,
+    DualQuaternion* dualQuaternions,
+    int count);
+
+/* The segment of a joint from its origin to the mean origin of its children */
+struct BoneSegment {
+    int joint;
+    glm::vec3 start, end;
+};
+
+/* Bone segments of a bound skeleton (see Skeleton::bind()) at its binding pose */
+std::vector<BoneSegment> calculateBoneSegments(const Skeleton& skeleton);
+
+/**
+* Weights each vertex by the inverse fourth power of its distance to the
+* nearest bone segments, keeping the 4 strongest. The vertices are split
+* among the threads of a ThreadPool.
+*/
+void calculateSkinningWeights(
+    const std::vector<glm::vec3>& vertices,
+    const std::vector<BoneSegment>& segments,
+    std::vector<VertexInfluences>& influences);
+
+/**
+* Create a VBO with the influences and attach it to the VAO at locations 4
+* (uvec4 bone ids) and 5 (vec4 weights). Returns the VBO.
+*/
+GLuint uploadSkinningInfluences(GLuint VAO, const std::vector<VertexInfluences>& influences);
+
+/**
+* A palette of bone transformations in a texture buffer, read with texelFetch
+* (4 RGBA32F texels per mat4 or 2 per dual quaternion). Unlike a uniform
+* array it is not limited to a handful of bones.
+*/
+class BonePalette {
+public:
+    BonePalette(int bones = 64);
+    ~BonePalette();
+
+    /* Upload count transformations, the palette grows if needed */
+    void upload(const glm::mat4* transformations, int count);
+    void upload(const DualQuaternion* transformations, int count);
+
+    /*
+    * Bind the palette to a texture unit. The samplerBuffer is pointed at the
+    * unit once, when the program is set up: a sampler left on unit 0 with the
+    * sampler2Ds makes every draw fail.
+    */
+    void bind(int textureUnit = 3);
+
+    int capacity() const { return bones; }
+
+private:
+    BonePalette(const BonePalette&);
+    BonePalette& operator=(const BonePalette&);
+
+    void uploadData(const void* data, size_t size);
+
+    GLuint buffer = 0, texture = 0;
+    int bones;  // in mat4
+};
+
+/**
+* Linear blend skinning of a Drawable on the CPU, once per frame, into a VBO
+* of positions and normals. Every later pass (wireframe, shadows, ...) draws
+* the skinned vertices with useSkinning off instead of skinning them again.
+* Uses SSE when available. Both paths blend with the same weights in the same
+* order as the vertex shader, so the results are equal up to floating point
+* rounding (the GPU may fuse or reorder operations).
+*/
+class SkinnedMesh {
+public:
+    SkinnedMesh(Drawable* drawable, const std::vector<VertexInfluences>& influences);
+    ~SkinnedMesh();
+
+    /* Skin every vertex with the palette (indexed by bone id) */
+    void skin(const glm::mat4* palette);
+
+    /* Upload the vertices skinned by the last skin() */
+    void upload();
+
+    /* Draw with the skinned positions and normals and the drawable's uvs */
+    void bind();
+    void draw(int mode = GL_TRIANGLES);
+
+    // skinned x, y, z, nx, ny, nz of each vertex (and one float of padding)
+    std::vector<float> skinned;
+
+    /* Set to false to use the scalar path */
+    static bool useSIMD;
+
+private:
+    SkinnedMesh(const SkinnedMesh&);
+    SkinnedMesh& operator=(const SkinnedMesh&);
+
+    Drawable* drawable;  // not owned
+    // source vertices, structure of arrays
+    std::vector<float> px, py, pz, nx, ny, nz;
+    std::vector<VertexInfluences> influences;
+    GLuint VAO = 0, VBO = 0;
+};
+
+#endif
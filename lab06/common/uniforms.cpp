@@ -0,0 +1,41 @@
+#include "uniforms.h"
+#include <stdexcept>
+
+using namespace std;
+
+UniformBuffer::UniformBuffer(GLuint binding, size_t size, int count) :
+    binding(binding), size(size), count(count) {
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    // std140 rounds structs up to a vec4
+    blockSize = (size + 15) / 16 * 16;
+    stride = (blockSize + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, stride * count, NULL, GL_DYNAMIC_DRAW);
+    use(0);
+}
+
+UniformBuffer::~UniformBuffer() {
+    glDeleteBuffers(1, &buffer);
+}
+
+void UniformBuffer::update(const void* block, int index) {
+    if (index < 0 || index >= count) {
+        throw out_of_range("UniformBuffer::update(): no such block");
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, stride * index, size, block);
+}
+
+void UniformBuffer::use(int index) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, stride * index, blockSize);
+}
+
+void UniformBuffer::bindBlock(GLuint program, const char* blockName, GLuint binding) {
+    GLuint index = glGetUniformBlockIndex(program, blockName);
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, index, binding);
+    }
+}
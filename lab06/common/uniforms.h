@@ -0,0 +1,46 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <GL/glew.h>
+#include <cstddef>
+
+/**
+* A uniform buffer of count std140 blocks bound to one binding point, for
+* state that many draws and programs share: set once per frame or per
+* material instead of with a glUniform* per value and draw. The C++ structs
+* must follow std140, i.e. vec4 and mat4 members, a vec3 only followed by a
+* float. Each block is aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, so
+* use(index) selects one with glBindBufferRange.
+*/
+class UniformBuffer {
+public:
+    /* count blocks of size bytes, the size of the C++ struct */
+    UniformBuffer(GLuint binding, size_t size, int count = 1);
+    ~UniformBuffer();
+
+    /* Replace block index with glBufferSubData */
+    void update(const void* block, int index = 0);
+
+    template <typename T>
+    void update(const T& block, int index = 0) {
+        update((const void*) &block, index);
+    }
+
+    /* Bind block index to the binding point */
+    void use(int index = 0);
+
+    /* Connect the uniform block blockName of program to binding, if it has one */
+    static void bindBlock(GLuint program, const char* blockName, GLuint binding);
+
+private:
+    UniformBuffer(const UniformBuffer&);
+    UniformBuffer& operator=(const UniformBuffer&);
+
+    GLuint buffer, binding;
+    size_t size;       // of the C++ struct
+    size_t blockSize;  // rounded up to a vec4
+    size_t stride;
+    int count;
+};
+
+#endif
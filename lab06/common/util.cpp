@@ -1,6 +1,16 @@
 #include <GL/glew.h>
 #include <iostream>
+#include <stdexcept>
 #include <cmath>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 using namespace std;
 #include "util.h"
 
@@ -76,4 +86,77 @@ bool fileExists(const std::string & abs_filename) {
     }
 
     return ret;
-}
\ No newline at end of file
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) :
+    begin(NULL), length(0), fileHandle(NULL), mappingHandle(NULL) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Can't open the file: " + path);
+    }
+    fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length = (size_t) fileSize.QuadPart;
+    if (length == 0) {
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        throw runtime_error("Can't map the file: " + path);
+    }
+    mappingHandle = mapping;
+    begin = (const char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (begin == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw runtime_error("Can't map the file: " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (begin != NULL) UnmapViewOfFile(begin);
+    if (mappingHandle != NULL) CloseHandle(mappingHandle);
+    if (fileHandle != NULL) CloseHandle(fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) : begin(NULL), length(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw runtime_error("Can't open the file: " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw runtime_error("Can't stat the file: " + path);
+    }
+    length = (size_t) st.st_size;
+    if (length == 0) {
+        close(fd);
+        return;
+    }
+
+    void* mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw runtime_error("Can't map the file: " + path);
+    }
+    madvise(mapped, length, MADV_SEQUENTIAL);
+    begin = (const char*) mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (begin != NULL) munmap((void*) begin, length);
+}
+
+#endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
 
 /* We can use a function like this to print some GL capabilities of our adapter
 to the log file. handy if we want to debug problems on other people's computers
@@ -41,4 +42,28 @@ std::string getBaseDir(const std::string& filepath);
 */
 bool fileExists(const std::string& abs_filename);
 
+/**
+* Read only memory mapping of a whole file. The contents are accessed in place
+* without copying them to the heap. Throws if the file can't be opened.
+*/
+class MappedFile {
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    const char* data() const { return begin; }
+    size_t size() const { return length; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* begin;
+    size_t length;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,501 @@
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "vtp.h"
+#include "parsing.h"
+
+using namespace std;
+
+static const char* findChar(const char* p, const char* end, char c) {
+    const char* found = (const char*) memchr(p, c, end - p);
+    return found == NULL ? end : found;
+}
+
+static const char* findString(const char* p, const char* end, const char* s) {
+    size_t n = strlen(s);
+    while (p != end) {
+        p = findChar(p, end, s[0]);
+        if ((size_t) (end - p) < n) return end;
+        if (memcmp(p, s, n) == 0) return p;
+        ++p;
+    }
+    return end;
+}
+
+/**
+* A start tag: <name attr="value" ...> or <name ... />
+*/
+struct Tag {
+    const char* name;
+    size_t nameLength;
+    const char* attributes;
+    const char* attributesEnd;
+    bool closing, selfClosing;
+
+    bool is(const char* s) const {
+        return strlen(s) == nameLength && memcmp(name, s, nameLength) == 0;
+    }
+
+    bool attribute(const char* key, string& value) const {
+        size_t keyLength = strlen(key);
+        const char* p = attributes;
+        while (p != attributesEnd) {
+            p = skipSpace(p, attributesEnd);
+            const char* k = p;
+            while (p != attributesEnd && *p != '=' && !isSpace(*p)) ++p;
+            size_t length = p - k;
+            p = skipSpace(p, attributesEnd);
+            if (p == attributesEnd || *p != '=') return false;
+            p = skipSpace(p + 1, attributesEnd);
+            if (p == attributesEnd) return false;
+            char quote = *p++;
+            const char* v = p;
+            p = findChar(p, attributesEnd, quote);
+            if (length == keyLength && memcmp(k, key, keyLength) == 0) {
+                value.assign(v, p);
+                return true;
+            }
+            if (p != attributesEnd) ++p;
+        }
+        return false;
+    }
+
+    int intAttribute(const char* key, int defaultValue) const {
+        string value;
+        if (!attribute(key, value)) return defaultValue;
+        return atoi(value.c_str());
+    }
+};
+
+/* Read the tag starting at p (p points to '<'). Returns past its '>'. */
+static const char* readTag(const char* p, const char* end, Tag& tag) {
+    ++p;
+    tag.closing = p != end && *p == '/';
+    if (tag.closing) ++p;
+    tag.name = p;
+    while (p != end && !isSpace(*p) && *p != '>' && *p != '/') ++p;
+    tag.nameLength = p - tag.name;
+    tag.attributes = p;
+
+    // '>' may appear inside a quoted attribute value
+    char quote = 0;
+    while (p != end && (quote != 0 || *p != '>')) {
+        if (quote != 0) {
+            if (*p == quote) quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        }
+        ++p;
+    }
+    if (p == end) throw runtime_error("Unterminated tag in .vtp file");
+    tag.selfClosing = p[-1] == '/';
+    tag.attributesEnd = tag.selfClosing ? p - 1 : p;
+    return p + 1;
+}
+
+void scanVTP(const char* data, size_t size, VTPPiece& piece) {
+    enum Section { NONE, POINTS, POINT_DATA, POLYS } section = NONE;
+    const char* end = data + size;
+    const char* p = data;
+    bool inPiece = false, pieceDone = false, isPolyData = false;
+    piece.fileEnd = end;
+
+    while ((p = findChar(p, end, '<')) != end) {
+        if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+            p = findString(p, end, "-->");
+            continue;
+        }
+        if (end - p >= 2 && (p[1] == '?' || p[1] == '!')) {
+            p = findChar(p, end, '>');
+            continue;
+        }
+
+        Tag tag;
+        p = readTag(p, end, tag);
+        if (tag.closing) {
+            if (tag.is("Piece")) {
+                pieceDone = pieceDone || inPiece;
+            } else if (tag.is("Points") || tag.is("PointData") ||
+                tag.is("Polys")) {
+                section = NONE;
+            }
+            continue;
+        }
+
+        if (tag.is("AppendedData")) {
+            // raw data follows, so nothing after it can be tokenized
+            string encoding;
+            tag.attribute("encoding", encoding);
+            piece.appendedBase64 = encoding == "base64";
+            p = findChar(p, end, '_');
+            piece.appended = p == end ? end : p + 1;
+            break;
+        } else if (pieceDone) {
+            continue;
+        } else if (tag.is("VTKFile")) {
+            string value;
+            isPolyData = tag.attribute("type", value) && value == "PolyData";
+            if (tag.attribute("header_type", value)) {
+                if (value == "UInt64") {
+                    piece.headerSize = 8;
+                } else if (value != "UInt32") {
+                    throw runtime_error("Unsupported header_type: " + value);
+                }
+            }
+            if (tag.attribute("compressor", value) && !value.empty()) {
+                if (value != "vtkZLibDataCompressor") {
+                    throw runtime_error("Unsupported compressor: " + value);
+                }
+                piece.compressed = true;
+            }
+            piece.bigEndian = tag.attribute("byte_order", value) &&
+                value == "BigEndian";
+        } else if (tag.is("Piece")) {
+            inPiece = true;
+            piece.numberOfPoints = tag.intAttribute("NumberOfPoints", 0);
+            piece.numberOfPolys = tag.intAttribute("NumberOfPolys", 0);
+        } else if (tag.is("DataArray")) {
+            VTPDataArray array;
+            tag.attribute("Name", array.name);
+            tag.attribute("type", array.type);
+            tag.attribute("format", array.format);
+            array.numberOfComponents = tag.intAttribute("NumberOfComponents", 1);
+            string offset;
+            if (tag.attribute("offset", offset)) {
+                array.offset = (size_t) strtoull(offset.c_str(), NULL, 10);
+            }
+            array.begin = p;
+            array.end = tag.selfClosing ? p : findChar(p, end, '<');
+            p = array.end;
+
+            // the first array of a section is used unless a name matches
+            if (section == POINTS && piece.points.empty()) {
+                piece.points = array;
+            } else if (section == POINT_DATA && piece.normals.empty()) {
+                piece.normals = array;
+            } else if (section == POLYS && array.name == "connectivity") {
+                piece.connectivity = array;
+            } else if (section == POLYS && array.name == "offsets") {
+                piece.offsets = array;
+            }
+        } else if (tag.selfClosing) {
+            continue;
+        } else if (tag.is("Points")) {
+            section = POINTS;
+        } else if (tag.is("PointData")) {
+            section = POINT_DATA;
+        } else if (tag.is("Polys")) {
+            section = POLYS;
+        }
+    }
+
+    if (!isPolyData) throw runtime_error("Not a VTK PolyData file");
+    if (!inPiece) throw runtime_error("Can't access Piece");
+    if (piece.points.empty()) throw runtime_error("Can't access Points");
+    if (piece.connectivity.empty()) throw runtime_error("Can't access connectivity");
+    if (piece.offsets.empty()) throw runtime_error("Can't access offsets");
+}
+
+static const char* parseNumber(const char* p, const char* end, float& out) {
+    const char* next = parseFloat(p, end, out);
+    if (next == p) throw runtime_error("Invalid number in .vtp file");
+    return next;
+}
+
+static const char* parseNumber(const char* p, const char* end, int& out) {
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p == end || !isDigit(*p)) throw runtime_error("Invalid number in .vtp file");
+    int64_t value = 0;
+    while (p != end && isDigit(*p)) {
+        value = value * 10 + (*p - '0');
+        ++p;
+    }
+    out = (int) (negative ? -value : value);
+    return p;
+}
+
+template<typename T>
+static void readASCII(const VTPDataArray& array, T* out, size_t count) {
+    const char* p = array.begin;
+    for (size_t i = 0; i < count; i++) {
+        p = skipSpace(p, array.end);
+        if (p == array.end) {
+            throw runtime_error("DataArray " + array.name + " is too short");
+        }
+        p = parseNumber(p, array.end, out[i]);
+    }
+}
+
+/**
+* Sequential reader over the bytes of a binary DataArray, either stored raw
+* or base64 encoded. The base64 decoder treats '=' as the end of a quantum
+* and continues, since VTK encodes the compression header and the blocks as
+* separate base64 streams.
+*/
+class PayloadReader {
+public:
+    PayloadReader(const char* begin, const char* end, bool base64) :
+        p(begin), end(end), base64(base64) {
+    }
+
+    void read(void* out, size_t n) {
+        if (!base64) {
+            if ((size_t) (end - p) < n) throw runtime_error("DataArray is truncated");
+            memcpy(out, p, n);
+            p += n;
+            return;
+        }
+        unsigned char* bytes = (unsigned char*) out;
+        for (size_t i = 0; i < n; i++) {
+            if (pending == 0) decodeQuantum();
+            bytes[i] = decoded[3 - pending--];
+        }
+    }
+
+    /* Raw payloads are handed out in place instead of being copied */
+    const char* view(size_t n) {
+        if ((size_t) (end - p) < n) throw runtime_error("DataArray is truncated");
+        const char* data = p;
+        p += n;
+        return data;
+    }
+
+    bool isBase64() const { return base64; }
+
+    uint64_t readHeaderWord(size_t size, bool swap) {
+        unsigned char word[8] = {0};
+        read(word, size);
+        if (swap) {
+            for (size_t i = 0; i < size / 2; i++) {
+                unsigned char t = word[i];
+                word[i] = word[size - 1 - i];
+                word[size - 1 - i] = t;
+            }
+        }
+        if (size == 4) {
+            uint32_t value;
+            memcpy(&value, word, 4);
+            return value;
+        }
+        uint64_t value;
+        memcpy(&value, word, 8);
+        return value;
+    }
+
+private:
+    void decodeQuantum() {
+        int values[4], count = 0;
+        while (count < 4) {
+            if (p == end) throw runtime_error("DataArray is truncated");
+            char c = *p++;
+            int v = decodeChar(c);
+            if (v >= 0) {
+                values[count++] = v;
+            } else if (c == '=') {
+                break;
+            } else if (!isSpace(c)) {
+                throw runtime_error("Invalid base64 data in .vtp file");
+            }
+        }
+        if (count < 2) throw runtime_error("Invalid base64 data in .vtp file");
+        // skip the rest of the padding
+        while (p != end && *p == '=') ++p;
+        for (int i = count; i < 4; i++) values[i] = 0;
+
+        int bytes = count - 1;
+        decoded[0] = (unsigned char) ((values[0] << 2) | (values[1] >> 4));
+        decoded[1] = (unsigned char) ((values[1] << 4) | (values[2] >> 2));
+        decoded[2] = (unsigned char) ((values[2] << 6) | values[3]);
+        // left align the valid bytes at the end of the buffer
+        for (int i = bytes - 1; i >= 0; i--) decoded[3 - bytes + i] = decoded[i];
+        pending = bytes;
+    }
+
+    static int decodeChar(char c) {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    }
+
+    const char* p;
+    const char* end;
+    bool base64;
+    unsigned char decoded[3];
+    int pending = 0;
+};
+
+static bool hostIsBigEndian() {
+    const uint16_t one = 1;
+    return *(const unsigned char*) &one == 0;
+}
+
+static size_t typeSize(const string& type) {
+    if (type == "Int8" || type == "UInt8") return 1;
+    if (type == "Int16" || type == "UInt16") return 2;
+    if (type == "Int32" || type == "UInt32" || type == "Float32") return 4;
+    if (type == "Int64" || type == "UInt64" || type == "Float64") return 8;
+    throw runtime_error("Unsupported DataArray type: " + type);
+}
+
+template<typename S, typename T>
+static void convertValues(const char* bytes, bool swap, T* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        unsigned char word[sizeof(S)];
+        memcpy(word, bytes + i * sizeof(S), sizeof(S));
+        if (swap) {
+            for (size_t k = 0; k < sizeof(S) / 2; k++) {
+                unsigned char t = word[k];
+                word[k] = word[sizeof(S) - 1 - k];
+                word[sizeof(S) - 1 - k] = t;
+            }
+        }
+        S value;
+        memcpy(&value, word, sizeof(S));
+        out[i] = (T) value;
+    }
+}
+
+template<typename T>
+static void convertValues(const char* bytes, const string& type, bool swap,
+    T* out, size_t count) {
+    if (type == "Float32") convertValues<float>(bytes, swap, out, count);
+    else if (type == "Float64") convertValues<double>(bytes, swap, out, count);
+    else if (type == "Int8") convertValues<int8_t>(bytes, swap, out, count);
+    else if (type == "UInt8") convertValues<uint8_t>(bytes, swap, out, count);
+    else if (type == "Int16") convertValues<int16_t>(bytes, swap, out, count);
+    else if (type == "UInt16") convertValues<uint16_t>(bytes, swap, out, count);
+    else if (type == "Int32") convertValues<int32_t>(bytes, swap, out, count);
+    else if (type == "UInt32") convertValues<uint32_t>(bytes, swap, out, count);
+    else if (type == "Int64") convertValues<int64_t>(bytes, swap, out, count);
+    else if (type == "UInt64") convertValues<uint64_t>(bytes, swap, out, count);
+    else throw runtime_error("Unsupported DataArray type: " + type);
+}
+
+/* The VTK type that matches T bit for bit, so it can be copied directly */
+static const char* nativeType(const float*) { return "Float32"; }
+static const char* nativeType(const int*) { return "Int32"; }
+
+template<typename T>
+static void readBinary(const VTPPiece& piece, const VTPDataArray& array,
+    T* out, size_t count) {
+    PayloadReader reader(array.begin, array.end, true);
+    if (array.format == "appended") {
+        if (piece.appended == NULL) {
+            throw runtime_error("Missing AppendedData for " + array.name);
+        }
+        if (array.offset > (size_t) (piece.fileEnd - piece.appended)) {
+            throw runtime_error("Invalid offset of DataArray " + array.name);
+        }
+        reader = PayloadReader(piece.appended + array.offset, piece.fileEnd,
+            piece.appendedBase64);
+    }
+
+    bool swap = piece.bigEndian != hostIsBigEndian();
+    size_t elementSize = typeSize(array.type);
+    size_t needed = count * elementSize;
+
+    if (!piece.compressed) {
+        uint64_t size = reader.readHeaderWord(piece.headerSize, swap);
+        if (size < needed) {
+            throw runtime_error("DataArray " + array.name + " is too short");
+        }
+        if (!reader.isBase64() && !swap && array.type == nativeType(out)) {
+            memcpy(out, reader.view(needed), needed);
+        } else if (!reader.isBase64()) {
+            convertValues(reader.view(needed), array.type, swap, out, count);
+        } else {
+            vector<char> bytes(needed);
+            reader.read(&bytes[0], needed);
+            convertValues(&bytes[0], array.type, swap, out, count);
+        }
+        return;
+    }
+
+#ifdef HAVE_ZLIB
+    // header: #blocks, block size, last block size, compressed sizes
+    uint64_t numBlocks = reader.readHeaderWord(piece.headerSize, swap);
+    uint64_t blockSize = reader.readHeaderWord(piece.headerSize, swap);
+    uint64_t lastBlockSize = reader.readHeaderWord(piece.headerSize, swap);
+    vector<uint64_t> compressedSizes(numBlocks);
+    for (uint64_t i = 0; i < numBlocks; i++) {
+        compressedSizes[i] = reader.readHeaderWord(piece.headerSize, swap);
+    }
+    uint64_t total = numBlocks == 0 ? 0 :
+        (numBlocks - 1) * blockSize + (lastBlockSize != 0 ? lastBlockSize : blockSize);
+    if (total < needed) {
+        throw runtime_error("DataArray " + array.name + " is too short");
+    }
+
+    // only the blocks that hold the requested values are inflated
+    vector<char> bytes(needed);
+    vector<char> compressed;
+    size_t written = 0;
+    for (uint64_t i = 0; i < numBlocks && written < needed; i++) {
+        uLongf size = (uLongf) (i + 1 == numBlocks && lastBlockSize != 0 ?
+            lastBlockSize : blockSize);
+        const char* source;
+        if (reader.isBase64()) {
+            compressed.resize(compressedSizes[i]);
+            if (!compressed.empty()) reader.read(&compressed[0], compressed.size());
+            source = compressed.empty() ? NULL : &compressed[0];
+        } else {
+            source = reader.view(compressedSizes[i]);
+        }
+
+        if (needed - written >= size) {
+            if (uncompress((Bytef*) &bytes[written], &size, (const Bytef*) source,
+                (uLong) compressedSizes[i]) != Z_OK) {
+                throw runtime_error("Can't decompress DataArray " + array.name);
+            }
+        } else {
+            vector<char> block(size);
+            if (uncompress((Bytef*) &block[0], &size, (const Bytef*) source,
+                (uLong) compressedSizes[i]) != Z_OK) {
+                throw runtime_error("Can't decompress DataArray " + array.name);
+            }
+            size = (uLongf) (needed - written);
+            memcpy(&bytes[written], &block[0], size);
+        }
+        written += size;
+    }
+    if (written < needed) {
+        throw runtime_error("DataArray " + array.name + " is too short");
+    }
+    convertValues(needed == 0 ? NULL : &bytes[0], array.type, swap, out, count);
+#else
+    throw runtime_error("Compressed .vtp files need zlib, DataArray " + array.name);
+#endif
+}
+
+template<typename T>
+static void readDataArray(const VTPPiece& piece, const VTPDataArray& array,
+    T* out, size_t count) {
+    if (array.format == "ascii") {
+        readASCII(array, out, count);
+    } else if (array.format == "binary" || array.format == "appended") {
+        readBinary(piece, array, out, count);
+    } else {
+        throw runtime_error("Unsupported DataArray format: " + array.format);
+    }
+}
+
+void readVTPDataArray(const VTPPiece& piece, const VTPDataArray& array,
+    float* out, size_t count) {
+    readDataArray(piece, array, out, count);
+}
+
+void readVTPDataArray(const VTPPiece& piece, const VTPDataArray& array,
+    int* out, size_t count) {
+    readDataArray(piece, array, out, count);
+}
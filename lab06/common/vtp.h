@@ -0,0 +1,59 @@
+#ifndef VTP_H
+#define VTP_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+/**
+* A <DataArray> element of a .vtp file. The payload is not copied, begin/end
+* point to the text of the element inside the (mapped) file. Arrays with
+* format="appended" use offset into the <AppendedData> section instead.
+*/
+struct VTPDataArray {
+    std::string name, type, format;
+    int numberOfComponents = 1;
+    size_t offset = 0;
+    const char* begin = NULL;
+    const char* end = NULL;
+
+    bool empty() const { return begin == NULL; }
+};
+
+/**
+* The arrays of the first <Piece> of a PolyData file that are needed to build
+* a triangle mesh, together with the VTKFile attributes needed to decode the
+* binary formats.
+*/
+struct VTPPiece {
+    int numberOfPoints = 0, numberOfPolys = 0;
+    VTPDataArray points, normals, connectivity, offsets;
+
+    // header_type (UInt32 or UInt64), compressor and byte_order
+    size_t headerSize = 4;
+    bool compressed = false, bigEndian = false;
+
+    // payload of <AppendedData> that starts after the '_' marker
+    const char* appended = NULL;
+    const char* fileEnd = NULL;
+    bool appendedBase64 = false;
+};
+
+/**
+* Locate the DataArray payloads of a .vtp file without building a DOM. Only
+* the tags are tokenized, the payloads are skipped over.
+*/
+void scanVTP(const char* data, size_t size, VTPPiece& piece);
+
+/**
+* Decode exactly count values of a DataArray into out, converting them from
+* the stored type. Supports the ascii, binary (base64) and appended (raw or
+* base64) formats and, when built with zlib, vtkZLibDataCompressor blocks.
+* Throws if the array holds fewer values or can't be decoded.
+*/
+void readVTPDataArray(const VTPPiece& piece, const VTPDataArray& array,
+    float* out, size_t count);
+void readVTPDataArray(const VTPPiece& piece, const VTPDataArray& array,
+    int* out, size_t count);
+
+#endif
@@ -2,6 +2,10 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -16,9 +20,18 @@
 // Shader loading utilities and other
 #include <common/shader.h>
 #include <common/util.h>
+#include <common/profiler.h>
+#include <common/offscreen.h>
 #include <common/camera.h>
 #include <common/ModelLoader.h>
+#include <common/MeshCache.h>
+#include <common/AssetLoader.h>
 #include <common/skeleton.h>
+#include <common/skinning.h>
+#include <common/crowd.h>
+#include <common/animation.h>
+#include <common/kinematics.h>
+#include <common/uniforms.h>
 
 using namespace std;
 using namespace glm;
@@ -28,12 +41,11 @@ void initialize();
 void createContext();
 void mainLoop();
 void free();
-struct Light; struct Material;
-void uploadMaterial(const Material& mtl);
+struct Light;
 void uploadLight(const Light& light);
 map<int, mat4> calculateModelPoseFromCoordinates(map<int, float> q);
-vector<mat4> calculateSkinningTransformations(map<int, float> q);
-vector<float> calculateSkinningIndices();
+void calculateModelPoseFromCoordinates(const float* q, mat4* jointLocalTransformations);
+void calculateSkinningTransformations(const float* q, mat4* skinningTransformations);
 
 #define W_WIDTH 1024
 #define W_HEIGHT 768
@@ -41,18 +53,46 @@ vector<float> calculateSkinningIndices();
 
 // global variables
 GLFWwindow* window;
+Profiler profiler("lab06.trace.json");
+// --headless renders --frames frames into an offscreen framebuffer, orbiting
+// the camera once, and saves every --png-th one as frame_<n>.png; the other
+// options select what keys 1 to 6 toggle, so every path can be benchmarked
+bool headless = false;
+int headlessFrames = 600, pngInterval = 0;
+OffscreenContext* offscreen = NULL;
 Camera* camera;
 GLuint shaderProgram;
-GLuint projectionMatrixLocation, viewMatrixLocation, modelMatrixLocation;
-// light properties
-GLuint LaLocation, LdLocation, LsLocation, lightPositionLocation, lightPowerLocation;
-// material properties
-GLuint KdLocation, KsLocation, KaLocation, NsLocation;
+GLuint modelMatrixLocation;
+// the camera, light and materials are std140 uniform blocks, updated once per
+// frame (or once, for the materials) instead of with a glUniform per draw
+UniformBuffer *cameraBuffer, *lightBuffer, *materialBuffer;
 
-GLuint surfaceVAO, surfaceVerticesVBO, surfacesBoneIndecesVBO, maleBoneIndicesVBO;
+GLuint surfaceVAO, surfaceVerticesVBO, surfacesBoneIndecesVBO, maleInfluencesVBO;
 Drawable *segment, *skeletonSkin;
-GLuint useSkinningLocation, boneTransformationsLocation;
+GLuint useSkinningLocation, boneTransformationsLocation, bonePaletteLocation;
+GLuint useDualQuaternionsLocation;
 Skeleton* skeleton;
+BonePalette* bonePalette;
+// blend dual quaternions instead of matrices for the skin (keys 2 and 1),
+// or skin it once per frame on the CPU (key 3)
+bool useDualQuaternions = false, useCpuSkinning = false;
+SkinnedMesh* skinnedSkin;
+// a grid of walking skeletons drawn with instancing (key 4, +/- resize it)
+CrowdRenderer* crowd;
+bool useCrowd = false;
+int crowdSize = 64;
+ClipPlayer* walk;
+
+// Uniform buffer binding points
+enum UniformBinding {
+    CAMERA_BINDING = 0, LIGHT_BINDING, MATERIAL_BINDING
+};
+
+// std140 layout of the uniform blocks
+struct CameraBlock {
+    glm::mat4 V;
+    glm::mat4 P;
+};
 
 struct Light {
     glm::vec4 La;
@@ -69,6 +109,11 @@ struct Material {
     float Ns;
 };
 
+// Material names for mnemonic indexing of materialBuffer
+enum MaterialName {
+    BONE_MATERIAL = 0, MATERIALS
+};
+
 const Material boneMaterial{
     vec4{ 0.1, 0.1, 0.1, 1 },
     vec4{ 1.0, 1.0, 1.0, 1 },
@@ -99,6 +144,51 @@ enum BodyName {
     PELVIS = 0, FEMUR_R, TIBIA_R, TALUS_R, CALCN_R, TOES_R, TORSO, BODIES
 };
 
+// The joints of the model: offset, translating coordinates, rotating
+// coordinates and their axes, and whether the rotation precedes the offset
+#define NONE NO_COORDINATE, NO_COORDINATE, NO_COORDINATE
+static constexpr JointDefinition modelChain[JointName::JOINTS] = {
+    // base / pelvis joint
+    {{0, 0, 0}, {PELVIS_TRA_X, PELVIS_TRA_Y, PELVIS_TRA_Z}, {NONE},
+        {AXIS_X, AXIS_Y, AXIS_Z}, false},
+    // right hip joint
+    {{-0.072f, -0.068f, 0.086f}, {NONE}, {HIP_R_ADD, HIP_R_ROT, HIP_R_FLEX},
+        {AXIS_X, AXIS_Y, AXIS_Z}, false},
+    // right knee joint
+    {{0.0f, -0.40f, 0.0f}, {NONE}, {KNEE_R_FLEX, NO_COORDINATE, NO_COORDINATE},
+        {AXIS_X, AXIS_Y, AXIS_Z}, false},
+    // right ankle joint
+    {{0.0f, -0.430f, 0.0f}, {NONE}, {ANKLE_R_FLEX, NO_COORDINATE, NO_COORDINATE},
+        {AXIS_Z, AXIS_Y, AXIS_Z}, true},
+    // right calcn joint
+    {{-0.062f, -0.053f, 0.010f}, {NONE}, {NONE}, {AXIS_X, AXIS_Y, AXIS_Z}, false},
+    // right mtp joint
+    {{0.184f, -0.002f, 0.001f}, {NONE}, {NONE}, {AXIS_X, AXIS_Y, AXIS_Z}, false},
+    // back joint
+    {{-0.103f, 0.09f, 0.0f}, {NONE}, {LUMBAR_BEND, LUMBAR_ROT, LUMBAR_FLEX},
+        {AXIS_X, AXIS_Y, AXIS_Z}, false},
+};
+#undef NONE
+typedef KinematicChain<modelChain, JointName::JOINTS> ModelChain;
+
+// columns of an OpenSim (gait2392) motion for each coordinate
+static const map<string, int> motionColumns = {
+    {"pelvis_tx", CoordinateName::PELVIS_TRA_X},
+    {"pelvis_ty", CoordinateName::PELVIS_TRA_Y},
+    {"pelvis_tz", CoordinateName::PELVIS_TRA_Z},
+    {"pelvis_list", CoordinateName::PELVIS_ROT_X},
+    {"pelvis_rotation", CoordinateName::PELVIS_ROT_Y},
+    {"pelvis_tilt", CoordinateName::PELVIS_ROT_Z},
+    {"hip_flexion_r", CoordinateName::HIP_R_FLEX},
+    {"hip_adduction_r", CoordinateName::HIP_R_ADD},
+    {"hip_rotation_r", CoordinateName::HIP_R_ROT},
+    {"knee_angle_r", CoordinateName::KNEE_R_FLEX},
+    {"ankle_angle_r", CoordinateName::ANKLE_R_FLEX},
+    {"lumbar_extension", CoordinateName::LUMBAR_FLEX},
+    {"lumbar_bending", CoordinateName::LUMBAR_BEND},
+    {"lumbar_rotation", CoordinateName::LUMBAR_ROT}
+};
+
 // default pose used for binding the skeleton and the mesh
 static const map<int, float> bindingPose = {
     {CoordinateName::PELVIS_TRA_X,  0.0},
@@ -114,114 +204,81 @@ static const map<int, float> bindingPose = {
     {CoordinateName::LUMBAR_ROT, 0}
 };
 
-void uploadMaterial(const Material& mtl) {
-    glUniform4f(KaLocation, mtl.Ka.r, mtl.Ka.g, mtl.Ka.b, mtl.Ka.a);
-    glUniform4f(KdLocation, mtl.Kd.r, mtl.Kd.g, mtl.Kd.b, mtl.Kd.a);
-    glUniform4f(KsLocation, mtl.Ks.r, mtl.Ks.g, mtl.Ks.b, mtl.Ks.a);
-    glUniform1f(NsLocation, mtl.Ns);
+// true only on the frame the key goes down
+bool keyPressed(int key) {
+    static bool down[GLFW_KEY_LAST + 1];
+    bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+    bool result = pressed && !down[key];
+    down[key] = pressed;
+    return result;
+}
+
+// The walk of the crowd: models/walk.clip, converted from models/walk.mot the
+// first time, or else a one second cycle of key poses
+ClipPlayer* createWalk() {
+    if (fileExists("models/walk.clip")) {
+        return new ClipPlayer("models/walk.clip", CoordinateName::DOFS);
+    }
+    if (fileExists("models/walk.mot")) {
+        writeClip("models/walk.clip", loadMOT("models/walk.mot", motionColumns));
+        return new ClipPlayer("models/walk.clip", CoordinateName::DOFS);
+    }
+
+    AnimationClip clip;
+    int coordinates[] = {
+        CoordinateName::HIP_R_FLEX, CoordinateName::KNEE_R_FLEX,
+        CoordinateName::ANKLE_R_FLEX
+    };
+    for (int coordinate : coordinates) {
+        AnimationTrack track;
+        track.coordinate = coordinate;
+        for (int key = 0; key <= 16; key++) {
+            float phase = key / 16.0f * 2 * 3.14159f;
+            track.times.push_back(key / 16.0f);
+            if (coordinate == CoordinateName::HIP_R_FLEX) {
+                track.values.push_back(30 * sin(phase));
+            } else if (coordinate == CoordinateName::KNEE_R_FLEX) {
+                track.values.push_back(-30 * (1 + sin(phase + 1)) / 2);
+            } else {
+                track.values.push_back(10 * sin(phase));
+            }
+        }
+        clip.tracks.push_back(track);
+    }
+    return new ClipPlayer(compressClip(clip), CoordinateName::DOFS);
 }
 
 void uploadLight(const Light& light) {
-    glUniform4f(LaLocation, light.La.r, light.La.g, light.La.b, light.La.a);
-    glUniform4f(LdLocation, light.Ld.r, light.Ld.g, light.Ld.b, light.Ld.a);
-    glUniform4f(LsLocation, light.Ls.r, light.Ls.g, light.Ls.b, light.Ls.a);
-    glUniform3f(lightPositionLocation, light.lightPosition_worldspace.x,
-        light.lightPosition_worldspace.y, light.lightPosition_worldspace.z);
-    glUniform1f(lightPowerLocation, light.power);
+    lightBuffer->update(light);
 }
 
 map<int, mat4> calculateModelPoseFromCoordinates(map<int, float> q) {
-    map<int, mat4> jointLocalTransformations;
-
-    // base / pelvis joint
-    mat4 pelvisTra = translate(mat4(), vec3(
-        q[CoordinateName::PELVIS_TRA_X],
-        q[CoordinateName::PELVIS_TRA_Y],
-        q[CoordinateName::PELVIS_TRA_Z]));
-    mat4 pelvisRot = mat4(1.0);
-    jointLocalTransformations[JointName::BASE] = pelvisTra * pelvisRot;
-
-    // right hip joint
-    vec3 hipROffset = vec3(-0.072, -0.068, 0.086);
-    mat4 hipRTra = translate(mat4(), hipROffset);
-    mat4 hipRRotX = rotate(mat4(), radians(q[CoordinateName::HIP_R_ADD]), vec3(1, 0, 0));
-    mat4 hipRRotY = rotate(mat4(), radians(q[CoordinateName::HIP_R_ROT]), vec3(0, 1, 0));
-    mat4 hipRRotZ = rotate(mat4(), radians(q[CoordinateName::HIP_R_FLEX]), vec3(0, 0, 1));
-    jointLocalTransformations[JointName::HIP_R] = hipRTra * hipRRotX * hipRRotY * hipRRotZ;
-
-    // right knee joint
-    vec3 kneeROffset = vec3(0.0, -0.40, 0.0);
-    mat4 kneeRTra = translate(mat4(1.0), kneeROffset);
-    mat4 kneeRRotZ = rotate(mat4(), radians(q[CoordinateName::KNEE_R_FLEX]), vec3(1, 0, 0));
-    jointLocalTransformations[JointName::KNEE_R] = kneeRTra * kneeRRotZ;
-
-    // right ankle joint
-    vec3 ankleROffset = vec3(0, -0.430, 0);
-    mat4 ankleRTra = translate(mat4(1.0), ankleROffset);
-    mat4 ankleRRotZ = rotate(mat4(), radians(q[CoordinateName::ANKLE_R_FLEX]), vec3(0, 0, 1));
-    mat4 talusRModelMatrix = ankleRRotZ;
-    jointLocalTransformations[JointName::ANKLE_R] = ankleRRotZ * ankleRTra;
-
-    // right calcn joint
-    vec3 calcnROffset = vec3(-0.062, -0.053, 0.010);
-    mat4 calcnRTra = translate(mat4(1.0), calcnROffset);
-    jointLocalTransformations[JointName::SUBTALAR_R] = calcnRTra;
-
-    // right mtp joint
-    vec3 toesROffset = vec3(0.184, -0.002, 0.001);
-    mat4 mtpRTra = translate(mat4(1.0), toesROffset);
-    jointLocalTransformations[JointName::MTP_R] = mtpRTra;
-
-    // back joint
-    vec3 backOffset = vec3(-0.103, 0.09, 0.0);
-    mat4 lumbarTra = translate(mat4(1.0), backOffset);
-    mat4 lumbarRotX = rotate(mat4(), radians(q[CoordinateName::LUMBAR_BEND]), vec3(1, 0, 0));
-    mat4 lumbarRotY = rotate(mat4(), radians(q[CoordinateName::LUMBAR_ROT]), vec3(0, 1, 0));
-    mat4 lumbarRotZ = rotate(mat4(), radians(q[CoordinateName::LUMBAR_FLEX]), vec3(0, 0, 1));
-    jointLocalTransformations[JointName::BACK] = lumbarTra * lumbarRotX * lumbarRotY * lumbarRotZ;
+    float coordinates[CoordinateName::DOFS];
+    for (int i = 0; i < CoordinateName::DOFS; i++) {
+        coordinates[i] = q[i];
+    }
 
+    mat4 transformations[JointName::JOINTS];
+    calculateModelPoseFromCoordinates(coordinates, transformations);
+    map<int, mat4> jointLocalTransformations;
+    for (int i = 0; i < JointName::JOINTS; i++) {
+        jointLocalTransformations[i] = transformations[i];
+    }
     return jointLocalTransformations;
 }
 
-vector<mat4> calculateSkinningTransformations(map<int, float> q) {
-    auto jointLocalTransformationsBinding = calculateModelPoseFromCoordinates(bindingPose);
-    skeleton->setPose(jointLocalTransformationsBinding);
-    auto bindingWorldTransformations = skeleton->getJointWorldTransformations();
-
-    auto jointLocalTransformationsCurrent = calculateModelPoseFromCoordinates(q);
-    skeleton->setPose(jointLocalTransformationsCurrent);
-    auto currentWorldTransformations = skeleton->getJointWorldTransformations();
-
-    vector<mat4> skinningTransformations(JointName::JOINTS);
-    for (auto joint : bindingWorldTransformations) {
-        mat4 BInvWorld = glm::inverse(joint.second);
-        mat4 JWorld = currentWorldTransformations[joint.first];
-        skinningTransformations[joint.first] = JWorld * BInvWorld;
-    }
-
-    return skinningTransformations;
+// q holds DOFS coordinates, JOINTS transformations are written
+void calculateModelPoseFromCoordinates(const float* q, mat4* jointLocalTransformations) {
+    ModelChain::evaluate(q, jointLocalTransformations);
 }
 
-vector<float> calculateSkinningIndices() {
-    // Task 4.3: assign a body index for each vertex in the model (skin) based
-    // on its proximity to a body part (e.g. tight)
-    vector<float> indices;
-    for (auto v : skeletonSkin->indexedVertices) {
-        // dummy
-        //indices.push_back(1.0);
-        if (v.y <= -0.07 && v.y >= -0.5 && v.z > 0.00 && v.z < 0.25) {
-            indices.push_back(JointName::HIP_R);
-        } else if (v.y < -0.5 && v.y > -0.85 && v.z > 0.00 &&  v.z < 0.25) {
-            indices.push_back(JointName::KNEE_R);
-        } else if (v.y <= -0.85 &&  v.y >= -1.0 && v.z > 0.00 && v.z < 0.25) {
-            indices.push_back(JointName::ANKLE_R);
-        } else if (v.y > 0.0 || v.y > -0.4 && v.z > 0.25 || v.y > -0.4 && v.z < -0.25) {
-            indices.push_back(JointName::BACK);
-        } else {
-            indices.push_back(JointName::BASE);
-        }
-    }
-    return indices;
+// poses the skeleton at q and writes the JOINTS bone transformations; the
+// inverse binding transformations were computed once by skeleton->bind()
+void calculateSkinningTransformations(const float* q, mat4* skinningTransformations) {
+    mat4 jointLocalTransformations[JointName::JOINTS];
+    calculateModelPoseFromCoordinates(q, jointLocalTransformations);
+    skeleton->setPose(jointLocalTransformations, JointName::JOINTS);
+    skeleton->updateSkinningPalette(skinningTransformations);
 }
 
 void createContext() {
@@ -232,19 +289,28 @@ void createContext() {
 
     // get pointers to uniforms
     modelMatrixLocation = glGetUniformLocation(shaderProgram, "M");
-    viewMatrixLocation = glGetUniformLocation(shaderProgram, "V");
-    projectionMatrixLocation = glGetUniformLocation(shaderProgram, "P");
-    KaLocation = glGetUniformLocation(shaderProgram, "mtl.Ka");
-    KdLocation = glGetUniformLocation(shaderProgram, "mtl.Kd");
-    KsLocation = glGetUniformLocation(shaderProgram, "mtl.Ks");
-    NsLocation = glGetUniformLocation(shaderProgram, "mtl.Ns");
-    LaLocation = glGetUniformLocation(shaderProgram, "light.La");
-    LdLocation = glGetUniformLocation(shaderProgram, "light.Ld");
-    LsLocation = glGetUniformLocation(shaderProgram, "light.Ls");
-    lightPositionLocation = glGetUniformLocation(shaderProgram, "light.lightPosition_worldspace");
-    lightPowerLocation = glGetUniformLocation(shaderProgram, "light.power");
     useSkinningLocation = glGetUniformLocation(shaderProgram, "useSkinning");
     boneTransformationsLocation = glGetUniformLocation(shaderProgram, "boneTransformations");
+    bonePaletteLocation = glGetUniformLocation(shaderProgram, "bonePalette");
+    useDualQuaternionsLocation = glGetUniformLocation(shaderProgram, "useDualQuaternions");
+
+    // every sampler gets a unit of its own once: GL forbids samplers of
+    // different types on one unit, even if a branch never reads them
+    glUseProgram(shaderProgram);
+    glUniform1i(glGetUniformLocation(shaderProgram, "diffuseColorSampler"), 0);
+    glUniform1i(glGetUniformLocation(shaderProgram, "specularColorSampler"), 1);
+    glUniform1i(glGetUniformLocation(shaderProgram, "shadowMapSampler"), 2);
+    glUniform1i(bonePaletteLocation, 3);
+
+    // uniform blocks, the materials never change so they are uploaded here
+    UniformBuffer::bindBlock(shaderProgram, "CameraBlock", CAMERA_BINDING);
+    UniformBuffer::bindBlock(shaderProgram, "LightBlock", LIGHT_BINDING);
+    UniformBuffer::bindBlock(shaderProgram, "MaterialBlock", MATERIAL_BINDING);
+    cameraBuffer = new UniformBuffer(CAMERA_BINDING, sizeof(CameraBlock));
+    lightBuffer = new UniformBuffer(LIGHT_BINDING, sizeof(Light));
+    materialBuffer = new UniformBuffer(MATERIAL_BINDING, sizeof(Material),
+        MaterialName::MATERIALS);
+    materialBuffer->update(boneMaterial, BONE_MATERIAL);
 
     // segment coordinates using Drawable
     // The Drawable sends the vertices, normals (optional) and UV coordinates
@@ -321,76 +387,82 @@ void createContext() {
     // of each other (conceptually). Furthermore, each body can  have many
     // drawables (geometries) attached. The joints are related to each other
     // and form a parent child relations. A joint is attached on a body.
-    skeleton = new Skeleton(modelMatrixLocation, viewMatrixLocation, projectionMatrixLocation);
+    skeleton = new Skeleton(modelMatrixLocation);
+
+    // the meshes are decoded in parallel, the drawables are created (and
+    // uploaded) by loader.finish() on this thread
+    // not glfwGetTime(), GLFW is not initialized when headless uses EGL
+    chrono::steady_clock::time_point loadStart = chrono::steady_clock::now();
+    AssetLoader loader;
 
     // pelvis
     Joint* baseJoint = new Joint(); // creates a joint
     baseJoint->parent = NULL; // assigns the parent joint (NULL -> no parent)
-    skeleton->joints[JointName::BASE] = baseJoint; // adds the joint in the skeleton's dictionary
+    skeleton->addJoint(JointName::BASE, baseJoint); // adds the joint in the skeleton's dictionary
 
     Body* pelvisBody = new Body(); // creates a body
-    pelvisBody->drawables.push_back(new Drawable("models/sacrum.vtp")); // append 3 geometries
-    pelvisBody->drawables.push_back(new Drawable("models/pelvis.vtp"));
-    pelvisBody->drawables.push_back(new Drawable("models/l_pelvis.vtp"));
+    loader.load("models/sacrum.vtp", pelvisBody->drawables); // append 3 geometries
+    loader.load("models/pelvis.vtp", pelvisBody->drawables);
+    loader.load("models/l_pelvis.vtp", pelvisBody->drawables);
     pelvisBody->joint = baseJoint; // relates to a joint
     skeleton->bodies[BodyName::PELVIS] = pelvisBody; // adds the body in the skeleton's dictionary
 
     // right femur
     Joint* hipR = new Joint();
     hipR->parent = baseJoint;
-    skeleton->joints[JointName::HIP_R] = hipR;
+    skeleton->addJoint(JointName::HIP_R, hipR);
 
     Body* femurR = new Body();
-    femurR->drawables.push_back(new Drawable("models/femur.vtp"));
+    loader.load("models/femur.vtp", femurR->drawables);
     femurR->joint = hipR;
     skeleton->bodies[BodyName::FEMUR_R] = femurR;
 
     // right tibia
     Joint* kneeR = new Joint();
-    skeleton->joints[JointName::KNEE_R] = kneeR;
+    skeleton->addJoint(JointName::KNEE_R, kneeR);
 
     Body* tibiaR = new Body();
-    tibiaR->drawables.push_back(new Drawable("models/tibia.vtp"));
-    tibiaR->drawables.push_back(new Drawable("models/fibula.vtp"));
+    loader.load("models/tibia.vtp", tibiaR->drawables);
+    loader.load("models/fibula.vtp", tibiaR->drawables);
     tibiaR->joint = kneeR;
     skeleton->bodies[BodyName::TIBIA_R] = tibiaR;
 
     // right talus
     Joint* ankleR = new Joint();
-    skeleton->joints[JointName::ANKLE_R] = ankleR;
+    skeleton->addJoint(JointName::ANKLE_R, ankleR);
 
     Body* talusR = new Body();
-    talusR->drawables.push_back(new Drawable("models/talus.vtp"));
+    loader.load("models/talus.vtp", talusR->drawables);
     talusR->joint = ankleR;
     skeleton->bodies[BodyName::TALUS_R] = talusR;
 
     // right calcn
     Joint* subtalarR = new Joint();
-    skeleton->joints[JointName::SUBTALAR_R] = subtalarR;
+    skeleton->addJoint(JointName::SUBTALAR_R, subtalarR);
 
     Body* calcnR = new Body();
-    calcnR->drawables.push_back(new Drawable("models/foot.vtp"));
+    loader.load("models/foot.vtp", calcnR->drawables);
     calcnR->joint = subtalarR;
     skeleton->bodies[BodyName::CALCN_R] = calcnR;
 
     // toes
     Joint* mtpR = new Joint();
-    skeleton->joints[JointName::MTP_R] = mtpR;
+    skeleton->addJoint(JointName::MTP_R, mtpR);
 
     Body* toesR = new Body();
-    toesR->drawables.push_back(new Drawable("models/bofoot.vtp"));
+    loader.load("models/bofoot.vtp", toesR->drawables);
     toesR->joint = mtpR;
     skeleton->bodies[BodyName::TOES_R] = toesR;
 
     // torso
     Joint* back = new Joint();
-    skeleton->joints[JointName::BACK] = back;
+    skeleton->addJoint(JointName::BACK, back);
 
     Body* torso = new Body();
-    torso->drawables.push_back(new Drawable("models/hat_spine.vtp"));
-    torso->drawables.push_back(new Drawable("models/hat_jaw.vtp"));
-    torso->drawables.push_back(new Drawable("models/hat_skull.vtp"));
-    torso->drawables.push_back(new Drawable("models/hat_ribs.vtp"));
+    loader.load("models/hat_spine.vtp", torso->drawables);
+    loader.load("models/hat_jaw.vtp", torso->drawables);
+    loader.load("models/hat_skull.vtp", torso->drawables);
+    loader.load("models/hat_ribs.vtp", torso->drawables);
     torso->joint = back;
     skeleton->bodies[BodyName::TORSO] = torso;
 
@@ -398,14 +470,35 @@ void createContext() {
     // corresponding geometries are located in the models folder.
 
     // skin
-    skeletonSkin = new Drawable("models/male.obj");
-    auto maleBoneIndices = calculateSkinningIndices();
-    glGenBuffers(1, &maleBoneIndicesVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, maleBoneIndicesVBO);
-    glBufferData(GL_ARRAY_BUFFER, maleBoneIndices.size() * sizeof(float),
-        &maleBoneIndices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(3);
+    loader.load("models/male.obj", skeletonSkin);
+    loader.finish();
+    double loadTime = chrono::duration<double>(
+        chrono::steady_clock::now() - loadStart).count();
+
+    // bind the skin at the binding pose, the inverse transformations are kept
+    // by the skeleton
+    skeleton->setPose(calculateModelPoseFromCoordinates(bindingPose));
+    skeleton->bind();
+
+    // Task 4.3: weight each vertex of the skin by its proximity to the bones
+    // (up to 4 per vertex), the palette of all bones is a texture buffer
+    vector<VertexInfluences> maleInfluences;
+    calculateSkinningWeights(skeletonSkin->indexedVertices,
+        calculateBoneSegments(*skeleton), maleInfluences);
+    maleInfluencesVBO = uploadSkinningInfluences(skeletonSkin->VAO, maleInfluences);
+    bonePalette = new BonePalette(JointName::JOINTS);
+    skinnedSkin = new SkinnedMesh(skeletonSkin, maleInfluences);
+    crowd = new CrowdRenderer(skeleton, shaderProgram);
+    // the bones are static meshes, drawn with one multi-draw (key 6)
+    skeleton->buildGeometryPool(shaderProgram);
+    walk = createWalk();
+
+    // run twice to compare a cold start (parsing) with a warm one (cache)
+    cout << "Loaded " << meshLoadStats.cacheHits + meshLoadStats.cacheMisses
+        << " meshes in " << loadTime * 1000 << " ms, "
+        << meshLoadStats.seconds * 1000 << " ms on " << loader.threads()
+        << " threads (" << meshLoadStats.cacheHits << " from cache, "
+        << meshLoadStats.cacheMisses << " parsed)" << endl;
 }
 
 void free() {
@@ -419,29 +512,81 @@ void free() {
     glDeleteVertexArrays(1, &surfaceVerticesVBO);
     glDeleteVertexArrays(1, &surfacesBoneIndecesVBO);
 
-    glDeleteVertexArrays(1, &maleBoneIndicesVBO);
+    glDeleteBuffers(1, &maleInfluencesVBO);
+    delete bonePalette;
+    delete skinnedSkin;
+    delete crowd;
+    delete walk;
+    delete cameraBuffer;
+    delete lightBuffer;
+    delete materialBuffer;
 
     glDeleteProgram(shaderProgram);
+    profiler.finish();
+    delete offscreen;
+    offscreen = NULL;
     glfwTerminate();
 }
 
 void mainLoop() {
     camera->position = vec3(0, 0, 2.5);
     int t = 0;
+    chrono::steady_clock::time_point headlessStart = chrono::steady_clock::now();
     do {
+        profiler.beginFrame();
         ++t;
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(shaderProgram);
 
         // camera
-        camera->update();
+        if (offscreen) {
+            camera->orbit(6.2832f * t / headlessFrames);
+        } else {
+            camera->update();
+        }
         mat4 projectionMatrix = camera->projectionMatrix;
         mat4 viewMatrix = camera->viewMatrix;
+        cameraBuffer->update(CameraBlock{ viewMatrix, projectionMatrix });
 
         // light
         uploadLight(light);
 
+        // input, none offscreen
+        if (window) {
+            // skinning method
+            if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
+                useDualQuaternions = useCpuSkinning = false;
+            } else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
+                useDualQuaternions = true;
+                useCpuSkinning = false;
+            } else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
+                useCpuSkinning = true;
+            }
+
+            // crowd
+            if (keyPressed(GLFW_KEY_4)) {
+                useCrowd = !useCrowd;
+            } else if (keyPressed(GLFW_KEY_EQUAL)) {
+                crowdSize *= 2;
+            } else if (keyPressed(GLFW_KEY_MINUS) && crowdSize > 1) {
+                crowdSize /= 2;
+            }
+
+            // frustum culling of the skeleton bodies and crowd instances
+            if (keyPressed(GLFW_KEY_5)) {
+                Frustum::enabled = !Frustum::enabled;
+                cout << "Frustum culling " << (Frustum::enabled ? "on" : "off") << endl;
+            }
+
+            // one multi-draw for the whole skeleton, or a draw per bone mesh
+            if (keyPressed(GLFW_KEY_6)) {
+                Skeleton::useGeometryPool = !Skeleton::useGeometryPool;
+                cout << "Geometry pool " << (Skeleton::useGeometryPool ? "on" : "off") << endl;
+            }
+        }
+        cullingStats = CullingStats();
+
         // Task 1.1: draw the two segment one after another v1-----v2/v1-----v2
         // The Drawables is used as follows:
         // 1) bind()
@@ -449,8 +594,6 @@ void mainLoop() {
         // 3) draw(TYPE), TYPE = [GL_LINES, GL_TRIANGLES, ...] Default = GL_TRIANGLES
         //*/
         glUniform1i(useSkinningLocation, 0);
-        glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 
         // first segment
         segment->bind();
@@ -487,8 +630,6 @@ void mainLoop() {
         // to the two coordinates
         /*/
         glUniform1i(useSkinningLocation, 0);
-        glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 
         segment->bind();
 
@@ -512,8 +653,6 @@ void mainLoop() {
         // positioned using the linear blend skinning (LBS) method
         mat4 modelSurf = mat4(1);
         glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &modelSurf[0][0]);
-        glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 
         // Task 2.2: define the binding transformations (B0, B1)
         // The binding is the inverse of the body's world transformation
@@ -551,18 +690,18 @@ void mainLoop() {
         // Task 3.1b: visualize the skeleton
         /*/
         glUniform1i(useSkinningLocation, 0);
-        uploadMaterial(boneMaterial);
+        materialBuffer->use(BONE_MATERIAL);
         skeleton->draw(viewMatrix, projectionMatrix);
         //*/
 
         // Task 3.2: assign values to the generalized coordinates and correct
-        // the transformations in calculateModelPoseFromCoordinates()
+        // the joints in modelChain
         // Homework 2: add 3 rotational DoFs for the pelvis and the necessary
         // DoFs for left leg.
         // Task 3.3: make the skeleton walk (approximately)
         // Homework 3: model Michael Jackson's Moonwalk .
         /*/
-        map<int, float> q;
+        float q[CoordinateName::DOFS] = {};
         q[CoordinateName::PELVIS_TRA_X] = 0;
         q[CoordinateName::PELVIS_TRA_Y] = 0;
         q[CoordinateName::PELVIS_TRA_Z] = 0;
@@ -575,11 +714,12 @@ void mainLoop() {
         q[CoordinateName::LUMBAR_BEND] = 0;
         q[CoordinateName::LUMBAR_ROT] = 0;
 
-        auto jointLocalTransformations = calculateModelPoseFromCoordinates(q);
-        skeleton->setPose(jointLocalTransformations);
+        mat4 jointLocalTransformations[JointName::JOINTS];
+        calculateModelPoseFromCoordinates(q, jointLocalTransformations);
+        skeleton->setPose(jointLocalTransformations, JointName::JOINTS);
 
         glUniform1i(useSkinningLocation, 0);
-        uploadMaterial(boneMaterial);
+        materialBuffer->use(BONE_MATERIAL);
         skeleton->draw(viewMatrix, projectionMatrix);
         //*/
 
@@ -589,67 +729,171 @@ void mainLoop() {
 
         mat4 maleModelMatrix = mat4(1);
         glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, &maleModelMatrix[0][0]);
-        glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, &viewMatrix[0][0]);
-        glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, &projectionMatrix[0][0]);
 
         // Task 4.2: calculate the bone transformations
-        auto T = calculateSkinningTransformations(q);
-        glUniformMatrix4fv(boneTransformationsLocation, T.size(),
-            GL_FALSE, &T[0][0][0]);
+        profiler.beginZone("skinning");
+        static mat4 skinningTransformations[JointName::JOINTS];
+        calculateSkinningTransformations(q, skinningTransformations);
+        if (useCpuSkinning) {
+            // skinned once, any further pass can draw skinnedSkin as it is
+            skinnedSkin->skin(skinningTransformations);
+            skinnedSkin->upload();
+            skinnedSkin->bind();
+        } else if (useDualQuaternions) {
+            // 8 instead of 16 floats per bone
+            static DualQuaternion skinningDualQuaternions[JointName::JOINTS];
+            calculateDualQuaternions(skinningTransformations,
+                skinningDualQuaternions, JointName::JOINTS);
+            bonePalette->upload(skinningDualQuaternions, JointName::JOINTS);
+        } else {
+            bonePalette->upload(skinningTransformations, JointName::JOINTS);
+        }
+        bonePalette->bind(3);
+        glUniform1i(useDualQuaternionsLocation, useDualQuaternions ? 1 : 0);
+        profiler.endZone();
 
-        glUniform1i(useSkinningLocation, 1);
+        // "2" blends the 4 weighted bones of each vertex
+        glUniform1i(useSkinningLocation, useCpuSkinning ? 0 : 2);
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        skeletonSkin->draw();
+        profiler.beginZone("skin draw");
+        if (useCpuSkinning) {
+            skinnedSkin->draw();
+        } else {
+            skeletonSkin->draw();
+        }
+        profiler.endZone();
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
         //*/
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-    } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+        // a crowd costs one draw per drawable, whatever its size
+        if (useCrowd) {
+            glUniform1i(useSkinningLocation, 0);
+            materialBuffer->use(BONE_MATERIAL);
+
+            // sample every walker, then pose them all as one batch
+            profiler.beginZone("crowd pose", false);
+            static vector<float> q;
+            static vector<mat4> jointLocalTransformations;
+            q.assign(crowdSize * CoordinateName::DOFS, 0.0f);
+            jointLocalTransformations.resize(crowdSize * JointName::JOINTS);
+            for (int i = 0; i < crowdSize; i++) {
+                walk->sample(t / 60.0f + i * 0.37f, &q[i * CoordinateName::DOFS]);
+            }
+            ModelChain::evaluate(q.data(), CoordinateName::DOFS, crowdSize,
+                jointLocalTransformations.data());
+            profiler.endZone();
+
+            profiler.beginZone("crowd draw");
+            crowd->begin();
+            int side = (int) ceil(sqrt((float) crowdSize));
+            for (int i = 0; i < crowdSize; i++) {
+                skeleton->setPose(&jointLocalTransformations[i * JointName::JOINTS],
+                    JointName::JOINTS);
+                crowd->addInstance(translate(mat4(), vec3(
+                    (i % side - side / 2) * 0.6f, 0, -(i / side) * 0.6f)));
+            }
+            crowd->draw(viewMatrix, projectionMatrix);
+            profiler.endZone();
+
+            // average frame time for the current size, e.g. to sweep 1, 2, 4, ...
+            static chrono::steady_clock::time_point crowdStart =
+                chrono::steady_clock::now();
+            static int crowdFrames = 0, measuredSize = crowdSize;
+            if (measuredSize != crowdSize) {
+                crowdStart = chrono::steady_clock::now();
+                crowdFrames = 0;
+                measuredSize = crowdSize;
+            } else if (++crowdFrames == 120) {
+                cout << "Crowd of " << crowdSize << ": "
+                    << chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - crowdStart).count() / crowdFrames
+                    << " ms per frame, " << cullingStats.drawn << " drawn, "
+                    << cullingStats.culled << " culled" << endl;
+                crowdStart = chrono::steady_clock::now();
+                crowdFrames = 0;
+            }
+        }
+
+        if (offscreen) {
+            if (pngInterval > 0 && t % pngInterval == 0) {
+                char name[32];
+                sprintf(name, "frame_%04d.png", t);
+                offscreen->savePNG(name);
+            }
+        } else {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+        // frame time percentiles in the title
+        if (profiler.endFrame() && !offscreen) {
+            glfwSetWindowTitle(window, (string(TITLE) + " | " + profiler.summary()).c_str());
+        }
+    } while (offscreen ? t < headlessFrames :
+        glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
         glfwWindowShouldClose(window) == 0);
-}
 
-void initialize() {
-    // Initialize GLFW
-    if (!glfwInit()) {
-        throw runtime_error("Failed to initialize GLFW\n");
+    if (offscreen) {
+        glFinish();
+        double seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - headlessStart).count();
+        cout << "Rendered " << t << " frames in " << seconds << " s: "
+            << t / seconds << " fps (" << profiler.summary() << ")" << endl;
     }
+}
 
-    glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+void initialize() {
+    if (headless) {
+        // without a display when EGL is available, see OffscreenContext
+        offscreen = new OffscreenContext(W_WIDTH, W_HEIGHT);
+        window = offscreen->window();
+    } else {
+        // Initialize GLFW
+        if (!glfwInit()) {
+            throw runtime_error("Failed to initialize GLFW\n");
+        }
 
-    // Open a window and create its OpenGL context
-    window = glfwCreateWindow(W_WIDTH, W_HEIGHT, TITLE, NULL, NULL);
-    if (window == NULL) {
-        glfwTerminate();
-        throw runtime_error(string(string("Failed to open GLFW window.") +
-            " If you have an Intel GPU, they are not 3.3 compatible." +
-            "Try the 2.1 version.\n"));
+        glfwWindowHint(GLFW_SAMPLES, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // Open a window and create its OpenGL context
+        window = glfwCreateWindow(W_WIDTH, W_HEIGHT, TITLE, NULL, NULL);
+        if (window == NULL) {
+            glfwTerminate();
+            throw runtime_error(string(string("Failed to open GLFW window.") +
+                " If you have an Intel GPU, they are not 3.3 compatible." +
+                "Try the 2.1 version.\n"));
+        }
+        glfwMakeContextCurrent(window);
     }
-    glfwMakeContextCurrent(window);
 
     // Start GLEW extension handler
     glewExperimental = GL_TRUE;
 
-    // Initialize GLEW
-    if (glewInit() != GLEW_OK) {
+    // Initialize GLEW; under EGL it finds no GLX display, but the GL
+    // functions are loaded all the same
+    if (glewInit() != GLEW_OK && !(offscreen && glGenFramebuffers)) {
         glfwTerminate();
         throw runtime_error("Failed to initialize GLEW\n");
     }
 
-    // Ensure we can capture the escape key being pressed below
-    glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+    if (offscreen) {
+        offscreen->bind();
+    } else {
+        // Ensure we can capture the escape key being pressed below
+        glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
-    // Hide the mouse and enable unlimited movement
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // Hide the mouse and enable unlimited movement
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // Set the mouse at the center of the screen
-    glfwPollEvents();
-    glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
+        // Set the mouse at the center of the screen
+        glfwPollEvents();
+        glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
+    }
 
     // Gray background color
     glClearColor(0.5f, 0.5f, 0.5f, 0.0f);
@@ -669,7 +913,51 @@ void initialize() {
     camera = new Camera(window);
 }
 
-int main(void) {
+/* Parses an on|off option value, returns false for anything else */
+bool parseSwitch(const string& value, bool& result) {
+    if (value != "on" && value != "off") return false;
+    result = value == "on";
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        string arg = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--headless") {
+            headless = true;
+            continue;
+        } else if (value.empty()) {
+            valid = false;
+        } else if (arg == "--frames") {
+            headlessFrames = atoi(value.c_str());
+        } else if (arg == "--png") {
+            pngInterval = atoi(value.c_str());
+        } else if (arg == "--crowd") {
+            crowdSize = atoi(value.c_str());
+            useCrowd = true;
+            valid = crowdSize > 0;
+        } else if (arg == "--skinning") {
+            useDualQuaternions = value == "dq";
+            useCpuSkinning = value == "cpu";
+            valid = value == "gpu" || value == "dq" || value == "cpu";
+        } else if (arg == "--pool") {
+            valid = parseSwitch(value, Skeleton::useGeometryPool);
+        } else if (arg == "--culling") {
+            valid = parseSwitch(value, Frustum::enabled);
+        } else {
+            valid = false;
+        }
+        i++;
+    }
+    if (!valid) {
+        cout << "Usage: " << argv[0] << " [--headless [--frames N] [--png N]]"
+            << " [--crowd N] [--skinning gpu|dq|cpu] [--pool on|off]"
+            << " [--culling on|off]" << endl;
+        return -1;
+    }
+
     try {
         initialize();
         createContext();
@@ -677,7 +965,7 @@ int main(void) {
         free();
     } catch (exception& ex) {
         cout << ex.what() << endl;
-        getchar();
+        if (!headless) getchar();
         free();
         return -1;
     }
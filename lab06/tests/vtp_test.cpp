@@ -0,0 +1,282 @@
+/**
+* Round trip test of the .vtp reader. A small PolyData piece is written in
+* every encoding that readVTPDataArray() supports and decoded against the
+* same piece written as ascii: binary (base64) and appended (raw or base64)
+* arrays, UInt32 and UInt64 headers, both byte orders and, when built with
+* zlib, vtkZLibDataCompressor blocks with a partial last block.
+*
+* Returns 0 when every case matches, prints the failing cases otherwise.
+*/
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include <common/vtp.h>
+
+using namespace std;
+
+// small enough that every compressed array ends with a partial block
+static const size_t BLOCK_SIZE = 20;
+
+struct Mesh {
+    vector<float> points, normals;
+    vector<int64_t> connectivity, offsets;
+};
+
+struct Encoding {
+    string format;          // binary or appended
+    bool appendedBase64;
+    size_t headerSize;      // 4 (UInt32) or 8 (UInt64)
+    bool bigEndian, compressed;
+
+    string describe() const {
+        char text[128];
+        snprintf(text, sizeof(text), "%s%s UInt%d %s%s", format.c_str(),
+            format == "appended" ? (appendedBase64 ? " base64" : " raw") : "",
+            (int) headerSize * 8, bigEndian ? "BigEndian" : "LittleEndian",
+            compressed ? " zlib" : "");
+        return text;
+    }
+};
+
+static Mesh makeMesh() {
+    Mesh mesh;
+    // a tetrahedron with values that are not exact in decimal
+    const float points[] = {
+        0.1f, -0.2f, 0.3f,  1.7f, 0.25f, -3.9f,
+        -2.2f, 4.1f, 0.0f,  1e-3f, 123.456f, -7.77f
+    };
+    mesh.points.assign(points, points + 12);
+    for (size_t i = 0; i < mesh.points.size(); i++) {
+        mesh.normals.push_back(mesh.points[i] / 10.0f);
+    }
+    const int64_t connectivity[] = {0, 1, 2, 0, 3, 1, 1, 3, 2, 2, 3, 0};
+    mesh.connectivity.assign(connectivity, connectivity + 12);
+    for (int64_t i = 1; i <= 4; i++) mesh.offsets.push_back(3 * i);
+    return mesh;
+}
+
+template<typename T>
+static string toASCII(const vector<T>& values) {
+    string text;
+    char value[32];
+    for (size_t i = 0; i < values.size(); i++) {
+        snprintf(value, sizeof(value), "%.9g ", (double) values[i]);
+        text += value;
+    }
+    return text;
+}
+
+static string base64(const string& bytes) {
+    static const char* alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string text;
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        uint32_t word = (unsigned char) bytes[i] << 16;
+        if (i + 1 < bytes.size()) word |= (unsigned char) bytes[i + 1] << 8;
+        if (i + 2 < bytes.size()) word |= (unsigned char) bytes[i + 2];
+        text += alphabet[(word >> 18) & 63];
+        text += alphabet[(word >> 12) & 63];
+        text += i + 1 < bytes.size() ? alphabet[(word >> 6) & 63] : '=';
+        text += i + 2 < bytes.size() ? alphabet[word & 63] : '=';
+    }
+    return text;
+}
+
+/* The bytes of value in the requested byte order */
+template<typename T>
+static string bytesOf(T value, bool bigEndian) {
+    unsigned char word[sizeof(T)];
+    memcpy(word, &value, sizeof(T));
+    const uint16_t one = 1;
+    bool hostBigEndian = *(const unsigned char*) &one == 0;
+    string bytes((const char*) word, sizeof(T));
+    if (bigEndian != hostBigEndian) {
+        for (size_t i = 0; i < sizeof(T); i++) bytes[i] = word[sizeof(T) - 1 - i];
+    }
+    return bytes;
+}
+
+static string headerWord(uint64_t value, const Encoding& encoding) {
+    return encoding.headerSize == 4 ?
+        bytesOf((uint32_t) value, encoding.bigEndian) :
+        bytesOf(value, encoding.bigEndian);
+}
+
+/*
+* The payload of one array as VTK writes it. The header and the data are
+* separate base64 streams when compressed, a single one otherwise.
+*/
+template<typename T>
+static string encodeArray(const vector<T>& values, const Encoding& encoding,
+    bool base64Encoded) {
+    string data;
+    for (size_t i = 0; i < values.size(); i++) {
+        data += bytesOf(values[i], encoding.bigEndian);
+    }
+
+    if (!encoding.compressed) {
+        string payload = headerWord(data.size(), encoding) + data;
+        return base64Encoded ? base64(payload) : payload;
+    }
+
+#ifdef HAVE_ZLIB
+    size_t numBlocks = (data.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    string header = headerWord(numBlocks, encoding) +
+        headerWord(BLOCK_SIZE, encoding) +
+        headerWord(data.size() % BLOCK_SIZE, encoding);
+    string blocks;
+    for (size_t i = 0; i < numBlocks; i++) {
+        size_t size = min(BLOCK_SIZE, data.size() - i * BLOCK_SIZE);
+        vector<Bytef> block(compressBound((uLong) size));
+        uLongf compressedSize = (uLongf) block.size();
+        if (compress(&block[0], &compressedSize,
+            (const Bytef*) data.data() + i * BLOCK_SIZE, (uLong) size) != Z_OK) {
+            throw runtime_error("Can't compress test data");
+        }
+        header += headerWord(compressedSize, encoding);
+        blocks.append((const char*) &block[0], compressedSize);
+    }
+    return base64Encoded ? base64(header) + base64(blocks) : header + blocks;
+#else
+    throw runtime_error("Compressed test cases need zlib");
+#endif
+}
+
+static string dataArray(const string& attributes, const string& format,
+    const string& content) {
+    return "<DataArray " + attributes + " format=\"" + format + "\"" +
+        (format == "appended" ? content + "/>\n" : ">\n" + content + "\n</DataArray>\n");
+}
+
+static string writeVTP(const Mesh& mesh, const Encoding* encoding) {
+    const char* attributes[] = {
+        "type=\"Float32\" Name=\"Points\" NumberOfComponents=\"3\"",
+        "type=\"Float32\" Name=\"Normals\" NumberOfComponents=\"3\"",
+        "type=\"Int64\" Name=\"connectivity\"",
+        "type=\"Int64\" Name=\"offsets\""
+    };
+    string arrays[4], appended;
+    bool base64Encoded = encoding != NULL &&
+        (encoding->format == "binary" || encoding->appendedBase64);
+    for (int i = 0; i < 4; i++) {
+        string content;
+        if (encoding == NULL) {
+            content = i == 0 ? toASCII(mesh.points) : i == 1 ?
+                toASCII(mesh.normals) : i == 2 ?
+                toASCII(mesh.connectivity) : toASCII(mesh.offsets);
+        } else {
+            content = i == 0 ? encodeArray(mesh.points, *encoding, base64Encoded) :
+                i == 1 ? encodeArray(mesh.normals, *encoding, base64Encoded) :
+                i == 2 ? encodeArray(mesh.connectivity, *encoding, base64Encoded) :
+                encodeArray(mesh.offsets, *encoding, base64Encoded);
+        }
+        string format = encoding == NULL ? "ascii" : encoding->format;
+        if (format == "appended") {
+            char offset[32];
+            snprintf(offset, sizeof(offset), " offset=\"%d\"", (int) appended.size());
+            appended += content;
+            content = offset;
+        }
+        arrays[i] = dataArray(attributes[i], format, content);
+    }
+
+    string file = "<?xml version=\"1.0\"?>\n<VTKFile type=\"PolyData\" version=\"1.0\"";
+    if (encoding != NULL) {
+        file += encoding->bigEndian ?
+            " byte_order=\"BigEndian\"" : " byte_order=\"LittleEndian\"";
+        file += encoding->headerSize == 8 ?
+            " header_type=\"UInt64\"" : " header_type=\"UInt32\"";
+        if (encoding->compressed) file += " compressor=\"vtkZLibDataCompressor\"";
+    }
+    char piece[128];
+    snprintf(piece, sizeof(piece),
+        "<Piece NumberOfPoints=\"%d\" NumberOfPolys=\"%d\">\n",
+        (int) mesh.points.size() / 3, (int) mesh.offsets.size());
+    file += ">\n<PolyData>\n";
+    file += piece;
+    file += "<Points>\n" + arrays[0] + "</Points>\n";
+    file += "<PointData Normals=\"Normals\">\n" + arrays[1] + "</PointData>\n";
+    file += "<Polys>\n" + arrays[2] + arrays[3] + "</Polys>\n";
+    file += "</Piece>\n</PolyData>\n";
+    if (!appended.empty()) {
+        file += encoding->appendedBase64 ?
+            "<AppendedData encoding=\"base64\">\n_" : "<AppendedData encoding=\"raw\">\n_";
+        file += appended + "\n</AppendedData>\n";
+    }
+    file += "</VTKFile>\n";
+    return file;
+}
+
+struct Decoded {
+    vector<float> points, normals;
+    vector<int> connectivity, offsets;
+};
+
+static Decoded readVTP(const string& file) {
+    VTPPiece piece;
+    scanVTP(file.data(), file.size(), piece);
+    Decoded decoded;
+    decoded.points.resize(3 * piece.numberOfPoints);
+    decoded.normals.resize(3 * piece.numberOfPoints);
+    decoded.offsets.resize(piece.numberOfPolys);
+    readVTPDataArray(piece, piece.points, &decoded.points[0], decoded.points.size());
+    readVTPDataArray(piece, piece.normals, &decoded.normals[0], decoded.normals.size());
+    readVTPDataArray(piece, piece.offsets, &decoded.offsets[0], decoded.offsets.size());
+    decoded.connectivity.resize(decoded.offsets.back());
+    readVTPDataArray(piece, piece.connectivity, &decoded.connectivity[0],
+        decoded.connectivity.size());
+    return decoded;
+}
+
+static bool matches(const Decoded& a, const Decoded& b) {
+    return a.points == b.points && a.normals == b.normals &&
+        a.connectivity == b.connectivity && a.offsets == b.offsets;
+}
+
+int main() {
+    Mesh mesh = makeMesh();
+    Decoded reference = readVTP(writeVTP(mesh, NULL));
+
+    vector<Encoding> encodings;
+    const char* formats[] = {"binary", "appended", "appended"};
+    for (int compressed = 0; compressed < 2; compressed++) {
+#ifndef HAVE_ZLIB
+        if (compressed) {
+            printf("skipped the zlib cases, built without zlib\n");
+            break;
+        }
+#endif
+        for (int format = 0; format < 3; format++) {
+            for (size_t headerSize = 4; headerSize <= 8; headerSize += 4) {
+                for (int bigEndian = 0; bigEndian < 2; bigEndian++) {
+                    Encoding encoding = {formats[format], format == 2,
+                        headerSize, bigEndian == 1, compressed == 1};
+                    encodings.push_back(encoding);
+                }
+            }
+        }
+    }
+
+    int failures = 0;
+    for (const Encoding& encoding : encodings) {
+        try {
+            if (!matches(readVTP(writeVTP(mesh, &encoding)), reference)) {
+                printf("FAILED %s: values differ from ascii\n",
+                    encoding.describe().c_str());
+                failures++;
+            }
+        } catch (const exception& ex) {
+            printf("FAILED %s: %s\n", encoding.describe().c_str(), ex.what());
+            failures++;
+        }
+    }
+    printf("%d of %d encodings match the ascii reference\n",
+        (int) encodings.size() - failures, (int) encodings.size());
+    return failures == 0 ? 0 : 1;
+}